@@ -0,0 +1,109 @@
+/**
+ * Compares VectorClock and TreeClock on traces with many threads that only synchronize with their neighbours.
+ *
+ * direct:  a thread joins the clock of its neighbour, like join and wait do.
+ * history: like PWRDetector with locks shared by neighbours, every release keeps a copy of the thread's clock in the
+ *          history of the lock and every acquire joins the history of the lock.
+ *
+ * Usage: clock_benchmark [threads] [synchronizations per thread]
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "../vectorclock.hpp"
+#include "../treeclock.hpp"
+
+const size_t HISTORY_SIZE = 5;
+
+struct Result {
+    long long milliseconds;
+    VectorClockValue checksum;
+};
+
+template<typename Clock>
+std::vector<Clock> create_threads(ThreadID thread_count) {
+    std::vector<Clock> threads = {};
+    for(ThreadID thread_id = 0; thread_id < thread_count; thread_id++) {
+        threads.push_back(Clock(thread_id));
+    }
+    return threads;
+}
+
+template<typename Clock>
+VectorClockValue checksum(std::vector<Clock> *threads) {
+    VectorClockValue sum = 0;
+    for(auto &thread : *threads) {
+        for(ThreadID thread_id = 0; thread_id < static_cast<ThreadID>(threads->size()); thread_id++) {
+            sum += thread.find(thread_id);
+        }
+    }
+    return sum;
+}
+
+template<typename Clock>
+Result run_direct(ThreadID thread_count, long long steps) {
+    std::vector<Clock> threads = create_threads<Clock>(thread_count);
+    std::mt19937 random(1);
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    for(long long step = 0; step < steps; step++) {
+        ThreadID thread_id = random() % thread_count;
+        ThreadID neighbour = random() % 2 == 0 ? (thread_id + 1) % thread_count : (thread_id + thread_count - 1) % thread_count;
+
+        threads[thread_id].merge_into(&threads[neighbour]);
+        threads[thread_id].increment(thread_id);
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    return Result{ std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count(), checksum(&threads) };
+}
+
+template<typename Clock>
+Result run_history(ThreadID thread_count, long long steps) {
+    std::vector<Clock> threads = create_threads<Clock>(thread_count);
+    // Lock i is shared by thread i and thread i + 1
+    std::vector<std::deque<Clock>> histories(thread_count);
+    std::mt19937 random(1);
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    for(long long step = 0; step < steps; step++) {
+        ThreadID thread_id = random() % thread_count;
+        ThreadID lock = random() % 2 == 0 ? thread_id : (thread_id + thread_count - 1) % thread_count;
+
+        for(auto &history_entry : histories[lock]) {
+            threads[thread_id].merge_into(&history_entry);
+        }
+        threads[thread_id].increment(thread_id);
+
+        histories[lock].push_front(threads[thread_id]);
+        if(histories[lock].size() > HISTORY_SIZE) {
+            histories[lock].pop_back();
+        }
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    return Result{ std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count(), checksum(&threads) };
+}
+
+bool report(const char *pattern, Result vector_clock, Result tree_clock) {
+    std::cout << pattern << ": VectorClock " << vector_clock.milliseconds << "ms, TreeClock " << tree_clock.milliseconds << "ms" << std::endl;
+    if(vector_clock.checksum != tree_clock.checksum) {
+        std::cout << "Clocks disagree!" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    ThreadID thread_count = argc > 1 ? std::atoi(argv[1]) : 1024;
+    long long steps = static_cast<long long>(thread_count) * (argc > 2 ? std::atoi(argv[2]) : 300);
+
+    std::cout << thread_count << " threads, " << steps << " synchronizations" << std::endl;
+    bool clocks_agree = report("direct", run_direct<VectorClock>(thread_count, steps), run_direct<TreeClock>(thread_count, steps));
+    clocks_agree &= report("history", run_history<VectorClock>(thread_count, steps), run_history<TreeClock>(thread_count, steps));
+    return clocks_agree ? 0 : 1;
+}
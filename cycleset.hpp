@@ -0,0 +1,80 @@
+#ifndef CYCLESET_H
+#define CYCLESET_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "lockframe_types.hpp"
+#include "lockset.hpp"
+
+/**
+ * Deadlock cycles in canonical form: the sorted threads of the cycle followed by its lock sequence rotated to start at
+ * the smallest lock. Chains through the same locks and threads that only differ in their locksets, their clocks or
+ * the dependency they start at share the form. Every cycle of the set has an id, counted from 1 in insertion order.
+ */
+class CycleSet {
+    public:
+        using Key = std::vector<int>;
+
+        // Key of the cycle that dependency closes on chain. Dependency needs the ThreadID id and the LockIndex lock.
+        template<typename Dependency>
+        static Key key_of(const std::vector<Dependency> &chain, const Dependency &dependency) {
+            size_t length = chain.size() + 1;
+            Key key(2 * length);
+            auto lock_at = [&](size_t i) { return i < chain.size() ? chain[i].lock : dependency.lock; };
+            size_t smallest = 0;
+            for(size_t i = 0; i < length; i++) {
+                key[i] = i < chain.size() ? chain[i].id : dependency.id;
+                if(lock_at(i) < lock_at(smallest)) {
+                    smallest = i;
+                }
+            }
+            std::sort(key.begin(), key.begin() + length);
+            for(size_t i = 0; i < length; i++) {
+                key[length + i] = lock_at((smallest + i) % length);
+            }
+            return key;
+        }
+
+        // Key of a closed cycle, the last dependency of which closes it.
+        template<typename Dependency>
+        static Key key_of(const std::vector<Dependency> &cycle) {
+            std::vector<Dependency> chain(cycle.begin(), cycle.end() - 1);
+            return key_of(chain, cycle.back());
+        }
+
+        // False if the cycle was already in the set.
+        bool insert(const Key &key) {
+            return cycles.emplace(key, static_cast<unsigned int>(cycles.size() + 1)).second;
+        }
+
+        // Id of the cycle, which is inserted first if it isn't in the set yet.
+        unsigned int id_of(const Key &key) {
+            return cycles.emplace(key, static_cast<unsigned int>(cycles.size() + 1)).first->second;
+        }
+
+        void clear() {
+            cycles.clear();
+        }
+
+        size_t size() const {
+            return cycles.size();
+        }
+
+    private:
+        struct Hash {
+            size_t operator()(const Key &key) const {
+                uint64_t value = key.size();
+                for(int element : key) {
+                    value ^= static_cast<uint32_t>(element) + 0x9E3779B97F4A7C15ULL + (value << 6) + (value >> 2);
+                }
+                return static_cast<size_t>(value);
+            }
+        };
+
+        std::unordered_map<Key, unsigned int, Hash> cycles = {};
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef DEPENDENCYINDEX_H
+#define DEPENDENCYINDEX_H
+
+#include <algorithm>
+#include <vector>
+#include "lockframe_types.hpp"
+#include "lockset.hpp"
+
+/**
+ * Lock dependencies of all threads grouped by the locks of their locksets. A chain can only be extended by a dependency
+ * holding the chain's last lock (LD-2), so the DFS of the UNDEAD detectors looks its candidates up here instead of
+ * scanning every dependency of every thread.
+ * T needs the ThreadID id of the dependency. Dependencies keep the order they were added in. Added with ascending ids,
+ * the candidates come in the order a full scan would find them.
+ */
+template<typename T>
+class DependencyIndex {
+    public:
+        class Range {
+            public:
+                Range(const T *first, const T *last) : first(first), last(last) {}
+                const T *begin() const { return first; }
+                const T *end() const { return last; }
+            private:
+                const T *first;
+                const T *last;
+        };
+
+        void clear() {
+            by_held_lock.clear();
+        }
+
+        void add(const LockSet &lockset, const T &dependency) {
+            for(LockIndex held : lockset) {
+                if(static_cast<size_t>(held) >= by_held_lock.size()) {
+                    by_held_lock.resize(held + 1);
+                }
+                by_held_lock[held].push_back(dependency);
+            }
+        }
+
+        // Dependencies whose lockset holds lock, in the order they were added.
+        Range holding(LockIndex lock) const {
+            if(static_cast<size_t>(lock) >= by_held_lock.size()) {
+                return Range(nullptr, nullptr);
+            }
+            const std::vector<T> &dependencies = by_held_lock[lock];
+            return Range(dependencies.data(), dependencies.data() + dependencies.size());
+        }
+
+        // Dependencies of threads after thread_id whose lockset holds lock, needs the ids to be added in ascending order.
+        Range holding_after(LockIndex lock, ThreadID thread_id) const {
+            if(static_cast<size_t>(lock) >= by_held_lock.size()) {
+                return Range(nullptr, nullptr);
+            }
+            const std::vector<T> &dependencies = by_held_lock[lock];
+            auto first = std::partition_point(dependencies.begin(), dependencies.end(),
+                                              [thread_id](const T &dependency) { return dependency.id <= thread_id; });
+            return Range(dependencies.data() + (first - dependencies.begin()), dependencies.data() + dependencies.size());
+        }
+
+    private:
+        std::vector<std::vector<T>> by_held_lock = {};
+};
+
+#endif
@@ -1,12 +1,47 @@
 #ifndef DETECTOR_H
 #define DETECTOR_H
 
+#include <cstddef>
 #include "lockframe_types.hpp"
 
+/**
+ * Precision/performance trade-offs of the detectors that can be chosen per run instead of per build.
+ */
+struct DetectorConfig {
+    // Entries kept per lock in the history of a thread (PWR, PWRUNDEAD, PWRUNDEADGuard), 0 disables the history.
+    size_t history_size = 5;
+    // Vector clocks kept per lock dependency (PWRUNDEAD, PWRUNDEADGuard), at least 1: 0 keeps the newest one as well.
+#ifdef PWRUNDEADDETECTOR_VC_PER_DEP_LIMIT
+    size_t vector_clocks_per_dependency = PWRUNDEADDETECTOR_VC_PER_DEP_LIMIT;
+#else
+    size_t vector_clocks_per_dependency = 5;
+#endif
+    // Threads searching for deadlock cycles once the trace is done (UNDEAD, PWRUNDEAD, PWRUNDEADGuard), the results
+    // don't depend on it.
+    size_t worker_threads = 1;
+    // Searches for the deadlock cycles of every new lock dependency as it appears instead of once the trace is done
+    // (UNDEAD). Reports the same cycles, in the order they became complete.
+    bool online_deadlock_detection = false;
+    // Limits of the deadlock cycle search (UNDEAD, PWRUNDEAD, PWRUNDEADGuard), 0 is unlimited. Cycles of more than
+    // max_chain_length dependencies are never searched. A search that runs out of states or milliseconds stops, the
+    // next get_races() continues with the dependencies it didn't finish as long as no acquire came in between.
+    // The online search of online_deadlock_detection only obeys max_chain_length, it can't stop and resume.
+    size_t max_chain_length = 0;
+    size_t max_search_states = 0;
+    size_t max_search_milliseconds = 0;
+    // Reports every deadlock cycle once, by its threads and its lock sequence (UNDEAD, PWRUNDEAD, PWRUNDEADGuard),
+    // instead of once per chain closing it. Chains that can only repeat a cycle are no longer searched.
+    bool unique_cycles = false;
+    // Gives every reported deadlock the id of its cycle (UNDEAD, PWRUNDEAD, PWRUNDEADGuard), the same for all chains
+    // closing it, so that RaceAggregationKey::LOCK_CYCLE can fold them. The detector keeps every reported cycle for it.
+    bool identify_cycles = false;
+};
+
 class LockFrame;
 class Detector {
     public:
         LockFrame* lockframe{};
+        DetectorConfig config{};
         virtual void read_event(ThreadID, TracePosition, ResourceName) {}
         virtual void write_event(ThreadID, TracePosition, ResourceName) {}
         virtual void acquire_event(ThreadID, TracePosition, ResourceName) {}
@@ -16,10 +51,53 @@ class Detector {
         virtual void notify_event(ThreadID, TracePosition, ResourceName) {}
         virtual void wait_event(ThreadID, TracePosition, ResourceName) {}
         virtual void get_races() {}
+        // Whether the last get_races() found every race, false if the search limits of the config cut it short.
+        virtual bool is_complete() const { return true; }
+
+        // Handles count events in trace order. Detectors that are final can override it with dispatch_events(this, ...),
+        // which binds the handlers statically instead of making a virtual call per event.
+        virtual void process_batch(const Event *events, size_t count);
 
         //#ifdef COLLECT_STATISTICS
         virtual void get_statistics() {}
         //#endif
 };
 
+template<typename D>
+inline void dispatch_events(D *detector, const Event *events, size_t count) {
+    for(size_t i = 0; i < count; i++) {
+        const Event &event = events[i];
+        switch(event.type) {
+            case EventType::READ:
+                detector->read_event(event.thread_id, event.trace_position, event.target);
+                break;
+            case EventType::WRITE:
+                detector->write_event(event.thread_id, event.trace_position, event.target);
+                break;
+            case EventType::ACQUIRE:
+                detector->acquire_event(event.thread_id, event.trace_position, event.target);
+                break;
+            case EventType::RELEASE:
+                detector->release_event(event.thread_id, event.trace_position, event.target);
+                break;
+            case EventType::FORK:
+                detector->fork_event(event.thread_id, event.trace_position, event.target);
+                break;
+            case EventType::JOIN:
+                detector->join_event(event.thread_id, event.trace_position, event.target);
+                break;
+            case EventType::NOTIFY:
+                detector->notify_event(event.thread_id, event.trace_position, event.target);
+                break;
+            case EventType::WAIT:
+                detector->wait_event(event.thread_id, event.trace_position, event.target);
+                break;
+        }
+    }
+}
+
+inline void Detector::process_batch(const Event *events, size_t count) {
+    dispatch_events(this, events, count);
+}
+
 #endif
\ No newline at end of file
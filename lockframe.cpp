@@ -3,50 +3,87 @@
 #include <sstream>
 #include "lockframe.hpp"
 
-void LockFrame::set_detector(Detector *d) {
+void LockFrame::set_detector(Detector *d, const DetectorConfig &config) {
     d->lockframe = this;
+    d->config = config;
     detector = d;
 }
 
 void LockFrame::read_event(ThreadID tid, TracePosition pos, ResourceName name) {
-    detector->read_event(tid, pos, name);
+    detector->read_event(thread_slots.slot(tid), pos, name);
 }
 
 void LockFrame::write_event(ThreadID tid, TracePosition pos, ResourceName name) {
-    detector->write_event(tid, pos, name);
+    detector->write_event(thread_slots.slot(tid), pos, name);
 }
 
 void LockFrame::acquire_event(ThreadID tid, TracePosition pos, ResourceName name) {
-    detector->acquire_event(tid, pos, name);
+    detector->acquire_event(thread_slots.slot(tid), pos, name);
 }
 
 void LockFrame::release_event(ThreadID tid, TracePosition pos, ResourceName name) {
-    detector->release_event(tid, pos, name);
+    detector->release_event(thread_slots.slot(tid), pos, name);
 }
 
 void LockFrame::fork_event(ThreadID tid, TracePosition pos, ThreadID tid2) {
-    detector->fork_event(tid, pos, tid2);
+    // Assign the slots in trace order, argument evaluation order is unspecified.
+    ThreadID slot = thread_slots.slot(tid);
+    detector->fork_event(slot, pos, thread_slots.slot(tid2));
 }
 
 void LockFrame::join_event(ThreadID tid, TracePosition pos, ThreadID tid2) {
-    detector->join_event(tid, pos, tid2);
+    ThreadID slot = thread_slots.slot(tid);
+    detector->join_event(slot, pos, thread_slots.slot(tid2));
 }
 
 void LockFrame::notify_event(ThreadID tid, TracePosition pos, ResourceName name) {
-    detector->notify_event(tid, pos, name);
+    detector->notify_event(thread_slots.slot(tid), pos, name);
 }
 
 void LockFrame::wait_event(ThreadID tid, TracePosition pos, ResourceName name) {
-    detector->wait_event(tid, pos, name);
+    detector->wait_event(thread_slots.slot(tid), pos, name);
+}
+
+void LockFrame::process_batch(const Event *events, size_t count) {
+    translate_batch(events, count);
+    detector->process_batch(slot_events.data(), count);
+}
+
+void LockFrame::translate_batch(const Event *events, size_t count) {
+    slot_events.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        Event event = events[i];
+        event.thread_id = thread_slots.slot(event.thread_id);
+        if (event.type == EventType::FORK || event.type == EventType::JOIN) {
+            event.target = thread_slots.slot(event.target);
+        }
+        slot_events[i] = event;
+    }
 }
 
 void LockFrame::report_race(DataRace race) {
     //printf("\n---\nPOTENTIAL RACE FOUND %s@%d: T%d<-->T%d\n---\n", race.resource_name.c_str(), race.trace_position, race.thread_id_1, race.thread_id_2);
-    races.push_back(race);
+    race.thread_id_1 = thread_slots.key(race.thread_id_1);
+    race.thread_id_2 = thread_slots.key(race.thread_id_2);
+    race_count++;
+    if (race_sinks.empty()) {
+        races.push_back(race);
+        return;
+    }
+    for (auto *sink: race_sinks) {
+        sink->report(race);
+    }
 }
 
-std::vector<DataRace> LockFrame::get_races() {
+void LockFrame::add_race_sink(RaceSink *sink) {
+    race_sinks.push_back(sink);
+}
+
+const std::vector<DataRace> &LockFrame::get_races() {
     detector->get_races();
+    for (auto *sink: race_sinks) {
+        sink->finish();
+    }
     return races;
 }
 
@@ -2,20 +2,35 @@
 #define LOCKFRAME_H
 
 #include <string>
+#include <type_traits>
 #include <vector>
 #include "lockframe_types.hpp"
 #include "detector.hpp"
+#include "racesink.hpp"
+#include "slots.hpp"
 
 class Detector;
+/**
+ * Forwards the events of a trace to a detector behind a Detector pointer, every event is a virtual call.
+ * LockFrameT binds a final detector type statically instead, both are used through this interface.
+ */
 class LockFrame
 {
 public:
+    virtual ~LockFrame() = default;
     Detector *detector;
+    // Detectors only ever see dense thread slots, races are translated back to the trace's ThreadIDs.
+    SlotMap thread_slots;
+    // Races go to the sinks as they are found, only without sinks they are kept here.
+    std::vector<RaceSink *> race_sinks = {};
     std::vector<DataRace> races = {};
+    size_t race_count = 0;
+    // process_batch translates the ThreadIDs of a batch into slots here.
+    std::vector<Event> slot_events = {};
 #ifdef COLLECT_STATISTICS
     std::vector<StatisticReport> statistics = {};
 #endif
-    void set_detector(Detector *);
+    void set_detector(Detector *, const DetectorConfig & = DetectorConfig());
     void read_event(ThreadID, TracePosition, ResourceName);
     void write_event(ThreadID, TracePosition, ResourceName);
     void acquire_event(ThreadID, TracePosition, ResourceName);
@@ -24,14 +39,82 @@ public:
     void join_event(ThreadID, TracePosition, ThreadID);
     void notify_event(ThreadID, TracePosition, ResourceName);
     void wait_event(ThreadID, TracePosition, ResourceName);
+    // Same as calling the *_event methods for every event in order.
+    virtual void process_batch(const Event *events, size_t count);
+    // The sink is not owned and has to outlive the LockFrame.
+    void add_race_sink(RaceSink *);
     void report_race(DataRace);
-    std::vector<DataRace> get_races();
+    // Lets the detector conclude its analysis, the races are empty if they went to sinks.
+    const std::vector<DataRace> &get_races();
 #ifdef COLLECT_STATISTICS
     void report_statistic(const StatisticReport&);
     void report_statistic(std::string, std::string);
     void report_statistic(std::string, const std::vector<size_t>&);
     void report_statistic(std::string, size_t);
 #endif
+
+protected:
+    // Copies a batch into slot_events with the ThreadIDs replaced by slots.
+    void translate_batch(const Event *events, size_t count);
+};
+
+/**
+ * LockFrame for a detector type known at compile time. D is final, so its handlers are called directly and can be
+ * inlined into the event methods. Calls through a LockFrame pointer reach the same detector, per batch that costs
+ * one virtual call, per event it falls back to the virtual handlers.
+ */
+template<typename D>
+class LockFrameT : public LockFrame
+{
+    static_assert(std::is_base_of<Detector, D>::value && std::is_final<D>::value,
+                  "LockFrameT needs a final detector, otherwise its handlers stay virtual");
+
+public:
+    explicit LockFrameT(D *detector, const DetectorConfig &config = DetectorConfig()) : typed_detector(detector) {
+        set_detector(detector, config);
+    }
+
+    void read_event(ThreadID tid, TracePosition pos, ResourceName name) {
+        typed_detector->read_event(thread_slots.slot(tid), pos, name);
+    }
+
+    void write_event(ThreadID tid, TracePosition pos, ResourceName name) {
+        typed_detector->write_event(thread_slots.slot(tid), pos, name);
+    }
+
+    void acquire_event(ThreadID tid, TracePosition pos, ResourceName name) {
+        typed_detector->acquire_event(thread_slots.slot(tid), pos, name);
+    }
+
+    void release_event(ThreadID tid, TracePosition pos, ResourceName name) {
+        typed_detector->release_event(thread_slots.slot(tid), pos, name);
+    }
+
+    void fork_event(ThreadID tid, TracePosition pos, ThreadID tid2) {
+        ThreadID slot = thread_slots.slot(tid);
+        typed_detector->fork_event(slot, pos, thread_slots.slot(tid2));
+    }
+
+    void join_event(ThreadID tid, TracePosition pos, ThreadID tid2) {
+        ThreadID slot = thread_slots.slot(tid);
+        typed_detector->join_event(slot, pos, thread_slots.slot(tid2));
+    }
+
+    void notify_event(ThreadID tid, TracePosition pos, ResourceName name) {
+        typed_detector->notify_event(thread_slots.slot(tid), pos, name);
+    }
+
+    void wait_event(ThreadID tid, TracePosition pos, ResourceName name) {
+        typed_detector->wait_event(thread_slots.slot(tid), pos, name);
+    }
+
+    void process_batch(const Event *events, size_t count) override {
+        translate_batch(events, count);
+        typed_detector->process_batch(slot_events.data(), count);
+    }
+
+private:
+    D *typed_detector;
 };
 
 #endif
\ No newline at end of file
@@ -10,12 +10,35 @@ typedef int ResourceName;
 typedef std::string StatisticKey;
 typedef std::string StatisticValue;
 #endif
+enum class EventType : unsigned char
+{
+    READ,
+    WRITE,
+    ACQUIRE,
+    RELEASE,
+    FORK,
+    JOIN,
+    NOTIFY,
+    WAIT
+};
+
+// One event of a batch, target is the ResourceName or the target ThreadID of fork and join.
+struct Event
+{
+    EventType type;
+    ThreadID thread_id;
+    TracePosition trace_position;
+    int target;
+};
+
 typedef struct
 {
     ResourceName resource_name;
     TracePosition trace_position;
     ThreadID thread_id_1;
     ThreadID thread_id_2;
+    // Deadlocks found with DetectorConfig::identify_cycles: the id of the lock cycle, 0 otherwise.
+    unsigned int cycle = 0;
 } DataRace;
 
 #ifdef COLLECT_STATISTICS
@@ -0,0 +1,167 @@
+#ifndef LOCKGRAPH_H
+#define LOCKGRAPH_H
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "lockset.hpp"
+
+/**
+ * Lock-order graph of the dependencies the UNDEAD detectors collect: an edge m -> l for every lock m held while l was
+ * acquired. The locks of a deadlock cycle l_1 -> ... -> l_n -> l_1 (LD-2 and the closing l_n in ls_1) lie on a cycle
+ * of this graph, so they all belong to one strongly connected component of at least two locks.
+ * Dependencies acquiring a lock outside of such a component can't be part of any deadlock.
+ */
+class LockGraph {
+    public:
+        // Component of locks that are on no cycle of two or more locks.
+        static constexpr int NO_COMPONENT = -1;
+
+        void add_dependency(const LockSet &lockset, LockIndex lock) {
+            grow(lock);
+            for(LockIndex held : lockset) {
+                grow(held);
+                successors[held].push_back(lock);
+            }
+        }
+
+        // A single edge from -> to, for graphs that aren't built from the dependencies directly.
+        void add_edge(LockIndex from, LockIndex to) {
+            grow(std::max(from, to));
+            successors[from].push_back(to);
+        }
+
+        // Marks every lock reachable from one of roots, the roots included. reached needs to be all false.
+        void reachable_from(const LockSet &roots, std::vector<bool> *reached) const {
+            if(reached->size() < successors.size()) {
+                reached->resize(successors.size(), false);
+            }
+            std::vector<LockIndex> stack = {};
+            for(LockIndex root : roots) {
+                if(static_cast<size_t>(root) >= reached->size()) {
+                    reached->resize(root + 1, false);
+                }
+                if(!(*reached)[root]) {
+                    (*reached)[root] = true;
+                    stack.push_back(root);
+                }
+            }
+            while(!stack.empty()) {
+                LockIndex lock = stack.back();
+                stack.pop_back();
+                if(static_cast<size_t>(lock) >= successors.size()) {
+                    continue;
+                }
+                for(LockIndex successor : successors[lock]) {
+                    if(!(*reached)[successor]) {
+                        (*reached)[successor] = true;
+                        stack.push_back(successor);
+                    }
+                }
+            }
+        }
+
+        // Tarjan's algorithm, iterative so long lock chains can't overflow the stack. Call once all dependencies are added.
+        void find_components() {
+            size_t lock_count = successors.size();
+            for(auto &edges : successors) {
+                std::sort(edges.begin(), edges.end());
+                edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+            }
+
+            std::vector<int> index(lock_count, -1);
+            std::vector<int> lowlink(lock_count, 0);
+            std::vector<bool> on_stack(lock_count, false);
+            std::vector<LockIndex> stack = {};
+            // Locks whose successors are being visited, with the next successor to visit
+            std::vector<std::pair<LockIndex, size_t>> visiting = {};
+            int next_index = 0;
+            components.assign(lock_count, NO_COMPONENT);
+            component_count = 0;
+
+            auto discover = [&](LockIndex lock) {
+                index[lock] = lowlink[lock] = next_index++;
+                stack.push_back(lock);
+                on_stack[lock] = true;
+                visiting.emplace_back(lock, 0);
+            };
+
+            for(LockIndex root = 0; root < static_cast<LockIndex>(lock_count); root++) {
+                if(index[root] != -1) {
+                    continue;
+                }
+                discover(root);
+                while(!visiting.empty()) {
+                    LockIndex lock = visiting.back().first;
+                    size_t edge = visiting.back().second;
+                    if(edge < successors[lock].size()) {
+                        visiting.back().second++;
+                        LockIndex successor = successors[lock][edge];
+                        if(index[successor] == -1) {
+                            discover(successor);
+                        } else if(on_stack[successor]) {
+                            lowlink[lock] = std::min(lowlink[lock], index[successor]);
+                        }
+                        continue;
+                    }
+
+                    visiting.pop_back();
+                    if(!visiting.empty()) {
+                        LockIndex parent = visiting.back().first;
+                        lowlink[parent] = std::min(lowlink[parent], lowlink[lock]);
+                    }
+                    if(lowlink[lock] == index[lock]) {
+                        // lock is the root of a component, which is everything above it on the stack
+                        auto root_position = std::find(stack.rbegin(), stack.rend(), lock).base() - 1;
+                        bool is_cycle = stack.end() - root_position >= 2;
+                        for(auto member = root_position; member != stack.end(); ++member) {
+                            on_stack[*member] = false;
+                            if(is_cycle) {
+                                components[*member] = component_count;
+                            }
+                        }
+                        stack.erase(root_position, stack.end());
+                        if(is_cycle) {
+                            component_count++;
+                        }
+                    }
+                }
+            }
+        }
+
+        inline int component(LockIndex lock) const {
+            return static_cast<size_t>(lock) < components.size() ? components[lock] : NO_COMPONENT;
+        }
+
+        // Whether a dependency (lockset, lock) can be part of a deadlock: its lock and one of its held locks are on a
+        // common cycle, which every dependency of a deadlock has with its predecessor.
+        bool may_deadlock(const LockSet &lockset, LockIndex lock) const {
+            int lock_component = component(lock);
+            if(lock_component == NO_COMPONENT) {
+                return false;
+            }
+            for(LockIndex held : lockset) {
+                if(component(held) == lock_component) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        inline size_t size() const {
+            return component_count;
+        }
+
+    private:
+        std::vector<std::vector<LockIndex>> successors = {};
+        std::vector<int> components = {};
+        size_t component_count = 0;
+
+        void grow(LockIndex lock) {
+            if(static_cast<size_t>(lock) >= successors.size()) {
+                successors.resize(lock + 1);
+            }
+        }
+};
+
+#endif
@@ -0,0 +1,254 @@
+#ifndef LOCKSET_H
+#define LOCKSET_H
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+// Dense index of a lock, detectors intern their ResourceNames with a SlotMap.
+typedef int LockIndex;
+
+/**
+ * Set of lock indices as a bitset. The first 128 locks are stored inline, higher indices spill into a heap allocated tail,
+ * so copies of typical locksets don't allocate. Overlap, insert, erase and difference work on whole words.
+ * Iteration visits the locks in ascending index order.
+ */
+class LockSet {
+    public:
+        class iterator {
+            public:
+                iterator(const LockSet *lockset, size_t word_index) : lockset(lockset), word_index(word_index) {
+                    if(word_index < lockset->word_count()) {
+                        remaining = lockset->word(word_index);
+                        skip_empty();
+                    }
+                }
+                LockIndex operator*() const {
+                    return static_cast<LockIndex>(word_index * BITS_PER_WORD + __builtin_ctzll(remaining));
+                }
+                iterator &operator++() {
+                    remaining &= remaining - 1;
+                    skip_empty();
+                    return *this;
+                }
+                bool operator!=(const iterator &other) const { return word_index != other.word_index || remaining != other.remaining; }
+                bool operator==(const iterator &other) const { return !(*this != other); }
+            private:
+                const LockSet *lockset;
+                size_t word_index;
+                uint64_t remaining = 0;
+                void skip_empty() {
+                    while(remaining == 0 && ++word_index < lockset->word_count()) {
+                        remaining = lockset->word(word_index);
+                    }
+                    if(remaining == 0) {
+                        word_index = lockset->word_count();
+                    }
+                }
+        };
+
+        inline void insert(LockIndex lock) {
+            size_t word_index = lock / BITS_PER_WORD;
+            if(word_index >= word_count()) {
+                overflow_words.resize(word_index + 1 - INLINE_WORDS, 0);
+            }
+            mutable_word(word_index) |= bit(lock);
+        }
+
+        inline void erase(LockIndex lock) {
+            size_t word_index = lock / BITS_PER_WORD;
+            if(word_index < word_count()) {
+                mutable_word(word_index) &= ~bit(lock);
+                // Keep the tail trimmed, so equal sets have equal representations
+                while(!overflow_words.empty() && overflow_words.back() == 0) {
+                    overflow_words.pop_back();
+                }
+            }
+        }
+
+        inline bool contains(LockIndex lock) const {
+            size_t word_index = lock / BITS_PER_WORD;
+            return word_index < word_count() && (word(word_index) & bit(lock)) != 0;
+        }
+
+        inline bool overlaps(const LockSet &lockset) const {
+            if(((inline_words[0] & lockset.inline_words[0]) | (inline_words[1] & lockset.inline_words[1])) != 0) {
+                return true;
+            }
+            size_t common_overflow = std::min(overflow_words.size(), lockset.overflow_words.size());
+            for(size_t i = 0; i < common_overflow; i++) {
+                if((overflow_words[i] & lockset.overflow_words[i]) != 0) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Whether every lock of lockset is in this set.
+        inline bool includes(const LockSet &lockset) const {
+            if((lockset.inline_words[0] & ~inline_words[0]) != 0 || (lockset.inline_words[1] & ~inline_words[1]) != 0) {
+                return false;
+            }
+            for(size_t i = 0; i < lockset.overflow_words.size(); i++) {
+                uint64_t own = i < overflow_words.size() ? overflow_words[i] : 0;
+                if((lockset.overflow_words[i] & ~own) != 0) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Returns the locks of this set that are not in lockset.
+        LockSet difference(const LockSet &lockset) const {
+            LockSet result = *this;
+            for(size_t i = 0; i < result.word_count() && i < lockset.word_count(); i++) {
+                result.mutable_word(i) &= ~lockset.word(i);
+            }
+            while(!result.overflow_words.empty() && result.overflow_words.back() == 0) {
+                result.overflow_words.pop_back();
+            }
+            return result;
+        }
+
+        inline bool empty() const {
+            return inline_words[0] == 0 && inline_words[1] == 0 && overflow_words.empty();
+        }
+
+        inline size_t size() const {
+            size_t count = 0;
+            for(size_t i = 0; i < word_count(); i++) {
+                count += __builtin_popcountll(word(i));
+            }
+            return count;
+        }
+
+        bool operator==(const LockSet &lockset) const {
+            return inline_words[0] == lockset.inline_words[0] && inline_words[1] == lockset.inline_words[1] && overflow_words == lockset.overflow_words;
+        }
+
+        bool operator!=(const LockSet &lockset) const {
+            return !(*this == lockset);
+        }
+
+        // Arbitrary but strict order, allows LockSets as std::map keys.
+        bool operator<(const LockSet &lockset) const {
+            if(overflow_words.size() != lockset.overflow_words.size()) {
+                return overflow_words.size() < lockset.overflow_words.size();
+            }
+            for(size_t i = word_count(); i-- > 0;) {
+                if(word(i) != lockset.word(i)) {
+                    return word(i) < lockset.word(i);
+                }
+            }
+            return false;
+        }
+
+        size_t hash() const {
+            uint64_t hash = 0;
+            for(size_t i = 0; i < word_count(); i++) {
+                hash = (hash ^ word(i)) * 0x9E3779B97F4A7C15ull;
+            }
+            return static_cast<size_t>(hash ^ (hash >> 32));
+        }
+
+        struct Hash {
+            size_t operator()(const LockSet &lockset) const { return lockset.hash(); }
+        };
+
+        iterator begin() const { return iterator(this, 0); }
+        iterator end() const { return iterator(this, word_count()); }
+
+    private:
+        static const size_t BITS_PER_WORD = 64;
+        static const size_t INLINE_WORDS = 2;
+
+        uint64_t inline_words[INLINE_WORDS] = { 0, 0 };
+        std::vector<uint64_t> overflow_words = {};
+
+        static inline uint64_t bit(LockIndex lock) {
+            return uint64_t(1) << (lock % BITS_PER_WORD);
+        }
+        inline size_t word_count() const {
+            return INLINE_WORDS + overflow_words.size();
+        }
+        inline uint64_t word(size_t word_index) const {
+            return word_index < INLINE_WORDS ? inline_words[word_index] : overflow_words[word_index - INLINE_WORDS];
+        }
+        inline uint64_t &mutable_word(size_t word_index) {
+            return word_index < INLINE_WORDS ? inline_words[word_index] : overflow_words[word_index - INLINE_WORDS];
+        }
+};
+
+typedef int LockSetID;
+
+/**
+ * Hash-conses LockSets into immutable entries with dense ids, so equal locksets share one id and can be compared and
+ * used as map keys as plain integers. Adding or removing a lock is cached per (id, lock), repeated acquire/release
+ * patterns therefore resolve to a single hash lookup.
+ * References returned by get() stay valid for the lifetime of the table.
+ */
+class LockSetTable {
+    public:
+        static constexpr LockSetID EMPTY = 0;
+
+        LockSetTable() {
+            intern(LockSet());
+        }
+
+        LockSetID intern(const LockSet &lockset) {
+            auto id_iter = ids.find(lockset);
+            if(id_iter != ids.end()) {
+                return id_iter->second;
+            }
+            LockSetID id = static_cast<LockSetID>(locksets.size());
+            locksets.push_back(lockset);
+            ids.insert({ lockset, id });
+            return id;
+        }
+
+        inline const LockSet &get(LockSetID id) const {
+            return locksets[id];
+        }
+
+        // Returns the id of lockset id plus lock.
+        LockSetID with(LockSetID id, LockIndex lock) {
+            return transition(&insert_transitions, id, lock, true);
+        }
+
+        // Returns the id of lockset id without lock.
+        LockSetID without(LockSetID id, LockIndex lock) {
+            return transition(&erase_transitions, id, lock, false);
+        }
+
+        inline size_t size() const {
+            return locksets.size();
+        }
+
+    private:
+        std::deque<LockSet> locksets = {};
+        std::unordered_map<LockSet, LockSetID, LockSet::Hash> ids = {};
+        std::unordered_map<uint64_t, LockSetID> insert_transitions = {};
+        std::unordered_map<uint64_t, LockSetID> erase_transitions = {};
+
+        LockSetID transition(std::unordered_map<uint64_t, LockSetID> *transitions, LockSetID id, LockIndex lock, bool is_insert) {
+            uint64_t key = (static_cast<uint64_t>(id) << 32) | static_cast<uint32_t>(lock);
+            auto transition_iter = transitions->find(key);
+            if(transition_iter != transitions->end()) {
+                return transition_iter->second;
+            }
+
+            LockSet lockset = locksets[id];
+            if(is_insert) {
+                lockset.insert(lock);
+            } else {
+                lockset.erase(lock);
+            }
+            LockSetID target = intern(lockset);
+            transitions->insert({ key, target });
+            return target;
+        }
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <deque>
+#include <vector>
+
+/**
+ * Reference counted entries addressed by integer handles. Entries whose count drops to 0 go to a free list and keep their
+ * storage, so refilling a reused entry by assignment (e.g. with a clock of the same size) doesn't allocate.
+ * Detectors are single threaded, the counts are plain ints.
+ * References returned by get() stay valid while the pool grows.
+ */
+template<typename T>
+class RefCountPool {
+    public:
+        typedef int Handle;
+
+        // Returns an entry with a count of 1, its content is whatever the last user left behind.
+        Handle acquire() {
+            Handle handle;
+            if(free_handles.empty()) {
+                handle = static_cast<Handle>(entries.size());
+                entries.emplace_back();
+                reference_counts.push_back(0);
+            } else {
+                handle = free_handles.back();
+                free_handles.pop_back();
+            }
+            reference_counts[handle] = 1;
+            return handle;
+        }
+
+        inline void retain(Handle handle) {
+            reference_counts[handle] += 1;
+        }
+
+        inline void release(Handle handle) {
+            if(--reference_counts[handle] == 0) {
+                free_handles.push_back(handle);
+            }
+        }
+
+        inline T &get(Handle handle) {
+            return entries[handle];
+        }
+
+        inline const T &get(Handle handle) const {
+            return entries[handle];
+        }
+
+        // Number of entries ever allocated, live or free.
+        inline size_t capacity() const {
+            return entries.size();
+        }
+
+        inline size_t live() const {
+            return entries.size() - free_handles.size();
+        }
+
+    private:
+        std::deque<T> entries = {};
+        std::vector<int> reference_counts = {};
+        std::vector<Handle> free_handles = {};
+};
+
+#endif
@@ -1,72 +1,150 @@
 #include "pwrdetector.hpp"
 
+/**
+ * Brings the thread's history of lock up to date with the releases appended since it last looked and returns it.
+ * The thread's history only ever keeps its newest config.history_size entries, so the entries that already left the ring
+ * would have been dropped anyway. A thread reads a lock's history before each of its own releases of it, therefore
+ * all unread entries come from other threads. A thread that never read the lock starts with the whole ring, like it
+ * would have with a copy of the global history at its creation.
+ */
+PWRDetector::ThreadHistory* PWRDetector::read_history(Thread* thread, LockIndex lock) {
+    size_t appended = static_cast<size_t>(lock) < lock_histories.size() ? lock_histories[lock].appended : 0;
+    auto thread_history_iter = thread->history.find(lock);
+    if(thread_history_iter == thread->history.end()) {
+        if(appended == 0) return nullptr;
+        thread_history_iter = thread->history.emplace(lock, ThreadHistory{ HistoryBuffer(config.history_size) }).first;
+    }
+
+    ThreadHistory* thread_history = &thread_history_iter->second;
+    HistoryEntry* entries = thread_history->entries.data();
+    HistoryEntry* ring = lock_histories[lock].entries.data();
+    size_t history_size = config.history_size;
+    size_t ring_start = appended > history_size ? appended - history_size : 0;
+    for(size_t position = std::max(thread_history->read_until, ring_start); position < appended; position++) {
+        HistoryEntry entry = ring[position % history_size];
+        history_entries.retain(entry);
+        if(thread_history->size == history_size) {
+            thread_history->size -= 1;
+            history_entries.release(entries[thread_history->size]);
+        }
+        std::copy_backward(entries, entries + thread_history->size, entries + thread_history->size + 1);
+        entries[0] = entry;
+        thread_history->size += 1;
+    }
+    thread_history->read_until = appended;
+    return thread_history;
+}
+
 // This function was originally called w3 in the paper.
 // In the mean time, the algorithm was renamed from w3po to PWR.
-void PWRDetector::pwr_history_sync(Thread* thread, Resource* resource) {
-    for(ResourceName lock : thread->lockset) {
-        auto current_history_iter = thread->history.find(lock);
-        if(current_history_iter == thread->history.end()) continue;
-        auto current_history = &current_history_iter->second;
-
-        for(auto epoch_vc_pair_iter = current_history->begin(); epoch_vc_pair_iter != current_history->end();) {
-            auto thread_id_j = epoch_vc_pair_iter->get()->epoch.thread_id;
-            auto value_k = epoch_vc_pair_iter->get()->epoch.value;
-            auto vc_dash = &epoch_vc_pair_iter->get()->vector_clock;
+void PWRDetector::pwr_history_sync(Thread* thread, ResourceIndex resource) {
+    for(LockIndex lock : thread->lockset) {
+        ThreadHistory* current_history = read_history(thread, lock);
+        if(current_history == nullptr) continue;
+
+        HistoryEntry* entries = current_history->entries.data();
+        for(size_t i = 0; i < current_history->size;) {
+            const EpochVCPair* epoch_vc_pair = &history_entries.get(entries[i]);
+            auto thread_id_j = epoch_vc_pair->epoch.thread_id;
+            auto value_k = epoch_vc_pair->epoch.value;
+            auto vc_dash = &epoch_vc_pair->vector_clock;
             auto vc_value_at_j = thread->vector_clock.find(thread_id_j);
             auto vc_dash_value_at_j = vc_dash->find(thread_id_j);
-            
-            if(vc_dash_value_at_j <= vc_value_at_j) {
-                epoch_vc_pair_iter = current_history->erase(epoch_vc_pair_iter);
+
+            bool remove = vc_dash_value_at_j <= vc_value_at_j;
+            if(!remove && value_k < vc_value_at_j) {
+                thread->vector_clock.merge_into(vc_dash);
+                remove = true;
+            }
+
+            if(remove) {
+                history_entries.release(entries[i]);
+                std::copy(entries + i + 1, entries + current_history->size, entries + i);
+                current_history->size -= 1;
             } else {
-                if(value_k < vc_value_at_j) {
-                    thread->vector_clock.merge_into(vc_dash);
-                    epoch_vc_pair_iter = current_history->erase(epoch_vc_pair_iter);
-                } else {
-                    ++epoch_vc_pair_iter;
-                }
+                i++;
             }
         }
     }
 }
 
 // RW = { (i#Th(i)[i], LS_t(i) } U { (j#k, L) | (j#k, L) e RW(x) AND k > Th(i)[i] }
-void PWRDetector::update_read_write_events(Thread* thread, Resource* resource, bool is_write) {
+void PWRDetector::update_read_write_events(Thread* thread, ResourceIndex resource, bool is_write) {
     // (i#Th(i)[i], LS_t(i))
     // Current "timestamp" of the calling thread with its current locks.
+    Epoch epoch = Epoch { thread->id, thread->vector_clock.find(thread->id) };
+
+    // Fast path, all of RW(x) is from this thread and therefore ordered before the current access.
+    // A write replaces everything, a read only replaces the previous read.
+    if(resources.exclusive_thread[resource] == thread->id) {
+        if(is_write) {
+            resources.exclusive_read[resource].epoch.value = 0;
+            resources.exclusive_write[resource].epoch = epoch;
+            resources.exclusive_write[resource].lockset = thread->lockset;
+        } else {
+            resources.exclusive_read[resource].epoch = epoch;
+            resources.exclusive_read[resource].lockset = thread->lockset;
+        }
+        return;
+    }
+
+    inflate_read_write_events(resource);
+    auto read_write_events = &resources.read_write_events[resource];
 
     // { (j#k, L) | (j#k, L) e RW(x) AND k > Th(i)[i] }
     // Find everything in RW(x) where thread_2's epoch value is higher than the vector clock of thread_id is set at thread_2.
-    for(auto rw_pair_iter = resource->read_write_events.begin(); rw_pair_iter != resource->read_write_events.end();) {
+    bool only_own_events = true;
+    for(auto rw_pair_iter = read_write_events->begin(); rw_pair_iter != read_write_events->end();) {
         if(rw_pair_iter->epoch.value <= thread->vector_clock.find(rw_pair_iter->epoch.thread_id) && !(!is_write && rw_pair_iter->is_write)) {
-            rw_pair_iter = resource->read_write_events.erase(rw_pair_iter);
+            rw_pair_iter = read_write_events->erase(rw_pair_iter);
         } else {
+            only_own_events &= rw_pair_iter->epoch.thread_id == thread->id;
             ++rw_pair_iter;
         }
     }
 
-    resource->read_write_events.push_back(EpochLSPair { Epoch { thread->id, thread->vector_clock.find(thread->id) }, thread->lockset, is_write });
-}
+    read_write_events->push_back(EpochLSPair { epoch, thread->lockset, is_write });
 
-bool PWRDetector::check_locksets_overlap(std::vector<ResourceName> *ls1, std::vector<ResourceName> *ls2) {
-    for(ResourceName rn_t1 : *ls1) {
-        for(ResourceName rn_t2 : *ls2) {
-            if(rn_t1 == rn_t2) {
-                return true;
+    // Everything concurrent is gone, switch back to the fast path.
+    if(only_own_events) {
+        resources.exclusive_write[resource].epoch.value = 0;
+        resources.exclusive_read[resource].epoch.value = 0;
+        for(auto &rw_pair : *read_write_events) {
+            if(rw_pair.is_write) {
+                resources.exclusive_write[resource] = std::move(rw_pair);
+            } else {
+                resources.exclusive_read[resource] = std::move(rw_pair);
             }
         }
+        read_write_events->clear();
+        resources.exclusive_thread[resource] = thread->id;
+    }
+}
+
+// Moves RW(x) back into read_write_events once another thread accesses x.
+void PWRDetector::inflate_read_write_events(ResourceIndex resource) {
+    if(resources.exclusive_thread[resource] == NO_THREAD) {
+        return;
     }
 
-    return false;
+    auto read_write_events = &resources.read_write_events[resource];
+    if(resources.exclusive_write[resource].epoch.value != 0) {
+        read_write_events->push_back(std::move(resources.exclusive_write[resource]));
+    }
+    if(resources.exclusive_read[resource].epoch.value != 0) {
+        read_write_events->push_back(std::move(resources.exclusive_read[resource]));
+    }
+    resources.exclusive_thread[resource] = NO_THREAD;
 }
 
-void PWRDetector::add_races(ThreadID thread_id, TracePosition trace_position, ResourceName resource_name, std::vector<EpochLSPair> *rw_pairs, VectorClock *vc, std::vector<ResourceName> *ls) {
+void PWRDetector::add_races(ThreadID thread_id, TracePosition trace_position, ResourceName resource_name, std::vector<EpochLSPair> *rw_pairs, Clock *vc, LockSet *ls) {
     // Race check
     // Go through each currently stored read_write_event,
     // check if any lockset doesn't overlap with current one and
     // the other epoch is larger than thread_id's currently stored one for the other thread.
     for(auto &rw_pair : *rw_pairs) {
         if(rw_pair.epoch.value > vc->find(rw_pair.epoch.thread_id)) {
-            if(rw_pair.is_write && !check_locksets_overlap(ls, &rw_pair.lockset)) {
+            if(rw_pair.is_write && !ls->overlaps(rw_pair.lockset)) {
                 report_potential_race(resource_name, trace_position, thread_id, rw_pair.epoch.thread_id);
             }
         }
@@ -80,62 +158,58 @@ void PWRDetector::report_potential_race(ResourceName resource_name, TracePositio
 }
 
 /**
- * We have a thread-local history, but other threads need to "know" what happened before they are first encountered,
- * so we copy history from the other thread's
+ * A new thread starts with an empty history, read_history fills it from the shared lock histories on first use.
  */
 PWRDetector::Thread* PWRDetector::get_thread(ThreadID thread_id) {
-    auto current_thread_ptr = threads.find(thread_id);
-    if(current_thread_ptr == threads.end()) {
-        std::unordered_map<ResourceName, std::deque<std::shared_ptr<EpochVCPair>>> new_history = {};
-        for(auto history_pair : global_history) {
-            new_history[history_pair.first] = history_pair.second;
-        }
-
-        return &threads.insert({
+    Thread* current_thread = threads.find(thread_id);
+    if(current_thread == nullptr) {
+        return threads.insert(thread_id, Thread {
             thread_id,
-            Thread {
-                thread_id,
-                {},
-                new_history,
-                VectorClock(thread_id)
-            }
-        }).first->second;
+            {},
+            {},
+            Clock(thread_id)
+        });
     } else {
-        return &current_thread_ptr->second;
+        return current_thread;
     }
 }
 
-PWRDetector::Resource* PWRDetector::get_resource(ResourceName resource_name) {
-    auto current_resource_ptr = resources.find(resource_name);
-    if(current_resource_ptr == resources.end()) {
-        return &resources.insert(std::make_pair(resource_name, Resource{})).first->second;
-    } else {
-        return &current_resource_ptr->second;
+PWRDetector::ResourceIndex PWRDetector::get_resource(ResourceName resource_name) {
+    ResourceIndex resource = resource_slots.slot(resource_name);
+    if(static_cast<size_t>(resource) >= resources.last_acquire.size()) {
+        resources.resize(resource_slots.size());
     }
+    return resource;
 }
 
 void PWRDetector::read_event(ThreadID thread_id, TracePosition trace_position, ResourceName resource_name) {
     Thread* thread = get_thread(thread_id);
-    Resource* resource = get_resource(resource_name);
+    ResourceIndex resource = get_resource(resource_name);
+    // Accesses of the thread that made all of RW(x) can't race with it.
+    bool exclusive = resources.exclusive_thread[resource] == thread->id;
+    if(!exclusive) {
+        inflate_read_write_events(resource);
+    }
 
-    if(resource->last_write_occured) {
+    if(resources.last_write_occured[resource]) {
         auto last_read_merge = thread->last_read_merges.find(resource_name);
-        bool first_read_after_write = last_read_merge == thread->last_read_merges.end() || last_read_merge->second < resource->last_write_occured_at;
+        bool first_read_after_write = last_read_merge == thread->last_read_merges.end() || last_read_merge->second < resources.last_write_occured_at[resource];
         if(first_read_after_write) {
-            thread->last_read_merges[resource_name] = resource->last_write_occured_at;
+            thread->last_read_merges[resource_name] = resources.last_write_occured_at[resource];
         }
 
         if(first_read_after_write) {
             // if L_w(x)[j] > Th(i)[j] AND L_wl(x) ∩ LS(i) = {}
             // THERE IS A DISCREPANCY IN THE PAPER VS DISSERTATION HERE!
             // L_w and Th are swapped but then they wouldn't find the WR-Race
-            if(resource->last_write_vc.find(resource->last_write_thread) > thread->vector_clock.find(resource->last_write_thread) &&
-            !check_locksets_overlap(&resource->last_write_ls, &thread->lockset)) {
+            if(!exclusive &&
+            resources.last_write_vc[resource].find(resources.last_write_thread[resource]) > thread->vector_clock.find(resources.last_write_thread[resource]) &&
+            !resources.last_write_ls[resource].overlaps(thread->lockset)) {
                 add_races(
                     thread_id,
                     trace_position,
                     resource_name,
-                    &resource->read_write_events,
+                    &resources.read_write_events[resource],
                     &thread->vector_clock,
                     &thread->lockset
                 );
@@ -143,20 +217,22 @@ void PWRDetector::read_event(ThreadID thread_id, TracePosition trace_position, R
 
             // Th(i) = Th(i) |_| L_w(x)
             // "Compare values per thread, set to max ==> merge operation"
-            thread->vector_clock.merge_into(&resource->last_write_vc);
+            thread->vector_clock.merge_into(&resources.last_write_vc[resource]);
 
             pwr_history_sync(thread, resource);
         }
     }
 
-    add_races(
-        thread_id,
-        trace_position,
-        resource_name,
-        &resource->read_write_events,
-        &thread->vector_clock,
-        &thread->lockset
-    );
+    if(!exclusive) {
+        add_races(
+            thread_id,
+            trace_position,
+            resource_name,
+            &resources.read_write_events[resource],
+            &thread->vector_clock,
+            &thread->lockset
+        );
+    }
 
     update_read_write_events(thread, resource, false);
 
@@ -165,24 +241,27 @@ void PWRDetector::read_event(ThreadID thread_id, TracePosition trace_position, R
 
 void PWRDetector::write_event(ThreadID thread_id, TracePosition trace_position, ResourceName resource_name) {
     Thread* thread = get_thread(thread_id);
-    Resource* resource = get_resource(resource_name);
+    ResourceIndex resource = get_resource(resource_name);
 
-    add_races(
-        thread_id,
-        trace_position,
-        resource_name,
-        &resource->read_write_events,
-        &thread->vector_clock,
-        &thread->lockset
-    );
+    if(resources.exclusive_thread[resource] != thread->id) {
+        inflate_read_write_events(resource);
+        add_races(
+            thread_id,
+            trace_position,
+            resource_name,
+            &resources.read_write_events[resource],
+            &thread->vector_clock,
+            &thread->lockset
+        );
+    }
 
     update_read_write_events(thread, resource, true);
 
-    resource->last_write_vc = thread->vector_clock;
-    resource->last_write_thread = thread_id;
-    resource->last_write_ls = thread->lockset;
-    resource->last_write_occured = true;
-    resource->last_write_occured_at = trace_position;
+    resources.last_write_vc[resource] = thread->vector_clock;
+    resources.last_write_thread[resource] = thread_id;
+    resources.last_write_ls[resource] = thread->lockset;
+    resources.last_write_occured[resource] = true;
+    resources.last_write_occured_at[resource] = trace_position;
     thread->last_write_at = trace_position;
 
     thread->vector_clock.increment(thread->id);
@@ -190,17 +269,15 @@ void PWRDetector::write_event(ThreadID thread_id, TracePosition trace_position,
 
 void PWRDetector::acquire_event(ThreadID thread_id, TracePosition trace_position, ResourceName resource_name) {
     Thread* thread = get_thread(thread_id);
-    Resource* resource = get_resource(resource_name);
+    ResourceIndex resource = get_resource(resource_name);
 
     pwr_history_sync(thread, resource);
 
     // Add Resource to Lockset
-    if(std::find(thread->lockset.begin(), thread->lockset.end(), resource_name) == thread->lockset.end()) {
-        thread->lockset.push_back(resource_name);
-    }
+    thread->lockset.insert(lock_slots.slot(resource_name));
 
     // Set acquire History
-    resource->last_acquire = Epoch { thread_id, thread->vector_clock.find(thread_id) };
+    resources.last_acquire[resource] = Epoch { thread_id, thread->vector_clock.find(thread_id) };
 
     thread->lock_acquired_at[resource_name] = trace_position;
     
@@ -209,43 +286,39 @@ void PWRDetector::acquire_event(ThreadID thread_id, TracePosition trace_position
 
 void PWRDetector::release_event(ThreadID thread_id, TracePosition trace_position, ResourceName resource_name) {
     Thread* thread = get_thread(thread_id);
-    Resource* resource = get_resource(resource_name);
+    ResourceIndex resource = get_resource(resource_name);
 
     pwr_history_sync(thread, resource);
 
     // Remove Resource from Lockset
-    auto resource_iter = std::find(thread->lockset.begin(), thread->lockset.end(), resource_name);
-    if(resource_iter != thread->lockset.end()) {
-        thread->lockset.erase(resource_iter);
-    }
+    LockIndex lock = lock_slots.slot(resource_name);
+    thread->lockset.erase(lock);
 
     auto lock_acquired_at = thread->lock_acquired_at.find(resource_name);
 
     // Add to history
-    // Adds EpochVCPair to thread's history and global history.
-    // Limits history size per mutex to THREAD_HISTORY_SIZE (see at top of file).
-    if(lock_acquired_at != thread->lock_acquired_at.end() && lock_acquired_at->second < thread->last_write_at) {
-        std::shared_ptr<EpochVCPair> shared_epoch_vc_pair = std::shared_ptr<EpochVCPair>(new EpochVCPair{
-            resource->last_acquire,
-            thread->vector_clock
-        });
-        for(auto thread_iter = threads.begin(); thread_iter != threads.end(); ++thread_iter) {
-            if(thread_iter->first == thread->id) {
-                continue;
-            }
-
-            auto current_history = &thread_iter->second.history.emplace(std::piecewise_construct, std::forward_as_tuple(resource_name), std::forward_as_tuple()).first->second;
-            if(current_history->size() >= THREAD_HISTORY_SIZE) {
-                current_history->pop_back();
-            }
-            current_history->push_front(shared_epoch_vc_pair);
+    // Appends EpochVCPair to the shared history of the lock, other threads read it from there (see read_history).
+    if(config.history_size > 0 && lock_acquired_at != thread->lock_acquired_at.end() && lock_acquired_at->second < thread->last_write_at) {
+        if(static_cast<size_t>(lock) >= lock_histories.size()) {
+            lock_histories.resize(lock_slots.size(), LockHistory{ HistoryBuffer(config.history_size) });
         }
-
-        auto current_global_history = &global_history.emplace(std::piecewise_construct, std::forward_as_tuple(resource_name), std::forward_as_tuple()).first->second;
-        if(current_global_history->size() >= THREAD_HISTORY_SIZE) {
-            current_global_history->pop_back();
+        // Catch up first, so the thread never reads its own entry.
+        read_history(thread, lock);
+
+        // Reuses a released entry and its clock storage when possible.
+        HistoryEntry entry = history_entries.acquire();
+        EpochVCPair* epoch_vc_pair = &history_entries.get(entry);
+        epoch_vc_pair->epoch = resources.last_acquire[resource];
+        epoch_vc_pair->vector_clock = thread->vector_clock;
+
+        LockHistory* lock_history = &lock_histories[lock];
+        HistoryEntry* ring_slot = &lock_history->entries.data()[lock_history->appended % config.history_size];
+        if(lock_history->appended >= config.history_size) {
+            history_entries.release(*ring_slot);
         }
-        current_global_history->push_front(shared_epoch_vc_pair);
+        *ring_slot = entry;
+        lock_history->appended++;
+        thread->history.try_emplace(lock, ThreadHistory{ HistoryBuffer(config.history_size) }).first->second.read_until = lock_history->appended;
     }
 
     thread->vector_clock.increment(thread->id);
@@ -255,7 +328,9 @@ void PWRDetector::fork_event(ThreadID thread_id, TracePosition trace_position, T
     Thread* thread = get_thread(thread_id);
     Thread* target_thread = get_thread(target_thread_id);
 
-    target_thread->vector_clock = thread->vector_clock;
+    // The target may already be running (e.g. a signalled thread), it joins the parent's clock and keeps its own
+    // history, which also keeps the versions of a tree clock growing.
+    target_thread->vector_clock.merge_into(&thread->vector_clock);
     target_thread->vector_clock.increment(target_thread_id);
 
     thread->vector_clock.increment(thread->id);
@@ -275,11 +350,12 @@ void PWRDetector::notify_event(ThreadID thread_id, TracePosition trace_position,
     
     auto notifies_iter = notifies.find(resource_name);
     if(notifies_iter == notifies.end()) {
-        notifies_iter = notifies.insert({ resource_name, VectorClock() }).first;
+        notifies_iter = notifies.insert({ resource_name, Clock() }).first;
     }
 
-    notifies_iter->second.merge_into(&thread->vector_clock);
+    // Join into the thread and copy back, clocks are only merged into by their owning thread.
     thread->vector_clock.merge_into(&notifies_iter->second);
+    notifies_iter->second = thread->vector_clock;
 
     thread->vector_clock.increment(thread_id);
 }
@@ -299,4 +375,8 @@ void PWRDetector::wait_event(ThreadID thread_id, TracePosition trace_position, R
     notifies[resource_name] = thread->vector_clock;
 }
 
+void PWRDetector::process_batch(const Event *events, size_t count) {
+    dispatch_events(this, events, count);
+}
+
 void PWRDetector::get_races() {}
\ No newline at end of file
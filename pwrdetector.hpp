@@ -8,7 +8,7 @@
  *      - Write-NoSync
  *      - Fork-NoSync
  *      - Read-NoSync
- *      - Shared Pointer
+ *      - Shared Pointer (pooled, reference counted history entries)
  *      - LocalHistRemove if V'[j] <= V[j]
  *      - LocalHistRemove
  */
@@ -23,65 +23,132 @@
 #include <memory>
 #include "detector.hpp"
 #include "vectorclock.hpp"
+#include "treeclock.hpp"
+#include "slots.hpp"
+#include "lockset.hpp"
+#include "pool.hpp"
 
+// Default history size, histories up to this size are stored inline.
 #define THREAD_HISTORY_SIZE 5
 
 class LockFrame;
-class PWRDetector : public Detector {
+class PWRDetector final : public Detector {
     private:
+        // Tree clocks only pay off with many threads, see treeclock.hpp.
+#ifdef PWRDETECTOR_TREE_CLOCK
+        typedef TreeClock Clock;
+#else
+        typedef VectorClock Clock;
+#endif
+
         struct EpochVCPair {
             Epoch epoch;
-            VectorClock vector_clock;
+            Clock vector_clock;
+        };
+        // History entries live in history_entries and are shared by handle between lock and thread histories.
+        typedef RefCountPool<EpochVCPair>::Handle HistoryEntry;
+        // Room for config.history_size handles, only histories larger than THREAD_HISTORY_SIZE go to the heap.
+        struct HistoryBuffer {
+            HistoryEntry inline_entries[THREAD_HISTORY_SIZE] = {};
+            std::vector<HistoryEntry> heap_entries = {};
+
+            explicit HistoryBuffer(size_t capacity) {
+                if(capacity > THREAD_HISTORY_SIZE) {
+                    heap_entries.resize(capacity);
+                }
+            }
+            inline HistoryEntry* data() {
+                return heap_entries.empty() ? inline_entries : heap_entries.data();
+            }
+        };
+        // Releases of a lock are appended to its LockHistory, every thread reads them into its ThreadHistory on demand.
+        // Per lock only the last config.history_size entries are ever used, so the shared log is a ring of that size.
+        struct LockHistory {
+            HistoryBuffer entries;
+            size_t appended = 0;
+        };
+        struct ThreadHistory {
+            // Newest entry first
+            HistoryBuffer entries;
+            size_t size = 0;
+            // Number of entries of the LockHistory already read into entries.
+            size_t read_until = 0;
         };
         struct EpochLSPair {
             Epoch epoch;
-            std::vector<ResourceName> lockset;
+            LockSet lockset;
             bool is_write;
         };
         struct Thread {
             ThreadID id;
             // LS(i)
-            std::vector<ResourceName> lockset = {};
+            LockSet lockset = {};
             // H(y)
-            std::unordered_map<ResourceName, std::deque<std::shared_ptr<EpochVCPair>>> history = {};
+            std::unordered_map<LockIndex, ThreadHistory> history = {};
             // Th(i)
-            VectorClock vector_clock = {};
+            Clock vector_clock = {};
             std::unordered_map<ResourceName, TracePosition> last_read_merges = {};
             std::unordered_map<ResourceName, TracePosition> lock_acquired_at = {};
             TracePosition last_write_at = 0;
         };
-        struct Resource {
+
+        typedef int ResourceIndex;
+        static constexpr ThreadID NO_THREAD = -1;
+        // All resources as struct of arrays, indexed by the ResourceIndex interned in resource_slots.
+        struct ResourceTable {
             // RW(x)
-            std::vector<EpochLSPair> read_write_events = {};
+            std::vector<std::vector<EpochLSPair>> read_write_events = {};
+            // As long as a single thread made all accesses in RW(x), it holds at most its last write and the last read after it.
+            // RW(x) is then kept in exclusive_write/exclusive_read (value 0 if absent) instead of read_write_events.
+            std::vector<ThreadID> exclusive_thread = {};
+            std::vector<EpochLSPair> exclusive_write = {};
+            std::vector<EpochLSPair> exclusive_read = {};
             // Acq(y)
-            Epoch last_acquire = {};
+            std::vector<Epoch> last_acquire = {};
             // L_w(x)
-            VectorClock last_write_vc = {};
+            std::vector<Clock> last_write_vc = {};
             // L_wt(x)
-            ThreadID last_write_thread = {};
+            std::vector<ThreadID> last_write_thread = {};
             // L_wl(x)
-            std::vector<ResourceName> last_write_ls = {};
+            std::vector<LockSet> last_write_ls = {};
             // Helper variable, we need to check if write already occured,
             // but defaults stored in last_* variables don't tell us.
-            bool last_write_occured = false;
-            TracePosition last_write_occured_at = 0;
+            std::vector<char> last_write_occured = {};
+            std::vector<TracePosition> last_write_occured_at = {};
+
+            void resize(size_t size) {
+                read_write_events.resize(size);
+                exclusive_thread.resize(size, NO_THREAD);
+                exclusive_write.resize(size, EpochLSPair { Epoch { NO_THREAD, 0 }, {}, true });
+                exclusive_read.resize(size, EpochLSPair { Epoch { NO_THREAD, 0 }, {}, false });
+                last_acquire.resize(size);
+                last_write_vc.resize(size);
+                last_write_thread.resize(size);
+                last_write_ls.resize(size);
+                last_write_occured.resize(size, false);
+                last_write_occured_at.resize(size, 0);
+            }
         };
 
-        std::unordered_map<ThreadID, Thread> threads = {};
-        std::unordered_map<ResourceName, Resource> resources = {};
-        std::unordered_map<ResourceName, VectorClock> notifies = {};
-        // We don't know about all threads at the beginning, so we have to save a global history in order to load it into a newly spawned thread.
-        // This history is still optimized for limited size.
-        std::unordered_map<ResourceName, std::deque<std::shared_ptr<EpochVCPair>>> global_history = {};
+        SlotTable<Thread> threads = {};
+        // Memory access traces use addresses as ResourceName, the direct table may reach 2^24 names while they are dense.
+        SlotMap resource_slots = SlotMap(1 << 24);
+        ResourceTable resources = {};
+        SlotMap lock_slots;
+        // Indexed by LockIndex
+        std::vector<LockHistory> lock_histories = {};
+        RefCountPool<EpochVCPair> history_entries = {};
+        std::unordered_map<ResourceName, Clock> notifies = {};
 
-        void pwr_history_sync(Thread* thread, Resource* resource);
-        void update_read_write_events(Thread* thread, Resource* resource, bool is_write);
-        bool check_locksets_overlap(std::vector<ResourceName> *ls1, std::vector<ResourceName> *ls2);
-        void add_races(ThreadID thread_id, TracePosition trace_position, ResourceName resource_name, std::vector<EpochLSPair> *rw_pairs, VectorClock *vc, std::vector<ResourceName> *ls);
+        ThreadHistory* read_history(Thread* thread, LockIndex lock);
+        void pwr_history_sync(Thread* thread, ResourceIndex resource);
+        void update_read_write_events(Thread* thread, ResourceIndex resource, bool is_write);
+        void inflate_read_write_events(ResourceIndex resource);
+        void add_races(ThreadID thread_id, TracePosition trace_position, ResourceName resource_name, std::vector<EpochLSPair> *rw_pairs, Clock *vc, LockSet *ls);
         void report_potential_race(ResourceName resource_name, TracePosition trace_position, ThreadID thread_id_1, ThreadID thread_id_2);
     public:
         Thread* get_thread(ThreadID thread_id);
-        Resource* get_resource(ResourceName resource_name);
+        ResourceIndex get_resource(ResourceName resource_name);
         void read_event(ThreadID, TracePosition, ResourceName);
         void write_event(ThreadID, TracePosition, ResourceName);
         void acquire_event(ThreadID, TracePosition, ResourceName);
@@ -90,6 +157,7 @@ class PWRDetector : public Detector {
         void join_event(ThreadID, TracePosition, ThreadID);
         void notify_event(ThreadID, TracePosition, ResourceName);
         void wait_event(ThreadID, TracePosition, ResourceName);
+        void process_batch(const Event*, size_t) override;
         void get_races();
 };
 
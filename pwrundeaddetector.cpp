@@ -1,5 +1,4 @@
 #include <vector>
-#include <set>
 #include <deque>
 #include <unordered_map>
 #include <map>
@@ -10,18 +9,26 @@
 #include <sstream>
 #include "detector.hpp"
 #include "vectorclock.hpp"
+#include "treeclock.hpp"
 #include "pwrdetector.hpp"
+#include "slots.hpp"
+#include "lockset.hpp"
+#include "lockgraph.hpp"
+#include "dependencyindex.hpp"
+#include "taskpool.hpp"
+#include "searchbudget.hpp"
+#include "cycleset.hpp"
 
 /**
  * Optimized PWR + Undead
  */
-class PWRUNDEADDetector : public Detector
+class PWRUNDEADDetector final : public Detector
 {
 private:
-#ifdef PWRUNDEADDETECTOR_VC_PER_DEP_LIMIT
-    const size_t VECTOR_CLOCKS_PER_DEPENDENCY_LIMIT = PWRUNDEADDETECTOR_VC_PER_DEP_LIMIT;
+#ifdef PWRUNDEADDETECTOR_TREE_CLOCK
+    typedef TreeClock Clock;
 #else
-    const size_t VECTOR_CLOCKS_PER_DEPENDENCY_LIMIT = 5;
+    typedef VectorClock Clock;
 #endif
 
 #ifdef COLLECT_STATISTICS
@@ -32,21 +39,63 @@ private:
     struct LockDependency
     {
         ThreadID id;
-        ResourceName resource_name;
-        VectorClock *vector_clock;
-        const std::set<ResourceName> *lockset;
+        LockIndex lock;
+        Clock *vector_clock;
+        const LockSet *lockset;
+    };
+
+    // A (lockset, lock) dependency of a thread with all its clocks, as kept in the dependency index
+    struct DependencyClocks
+    {
+        ThreadID id;
+        LockIndex lock;
+        std::deque<Clock> *vector_clocks;
+        const LockSet *lockset;
+    };
+
+    // Search state of one worker thread in find_cycles
+    struct CycleSearch
+    {
+        std::vector<LockDependency> chain_stack = {};
+        std::vector<bool> is_traversed = {};
+        // (candidate, clock) positions per chain level to resume from, and where the search stopped
+        std::vector<size_t> resume = {};
+        std::vector<size_t> path = {};
+        size_t states = 0;
+        bool chains_cut = false;
+        // With unique_cycles: the cycles of the current start, and per chain level the candidates that closed one
+        CycleSet cycles = {};
+        std::vector<std::vector<const DependencyClocks *>> closed = {};
+        size_t skipped_candidates = 0;
+    };
+
+    // What the search from one start found, with unique_cycles or identify_cycles the cycle of every race
+    struct StartResult
+    {
+        std::vector<DataRace> races;
+        std::vector<CycleSet::Key> cycles;
+    };
+
+    // A start of find_cycles whose races weren't all reported yet, with the position the search stopped at and,
+    // once an earlier start was interrupted, what it found so far
+    struct PendingStart
+    {
+        size_t start;
+        std::vector<size_t> path;
+        bool is_finished;
+        StartResult found;
     };
 
     struct EpochVCPair
     {
         Epoch epoch;
-        VectorClock vector_clock;
+        Clock vector_clock;
     };
 
     struct EpochLSPair
     {
         Epoch epoch;
-        std::set<ResourceName> lockset;
+        LockSetID lockset;
         bool is_write;
     };
 
@@ -57,14 +106,12 @@ private:
          * We save all acq vectorclocks that are mapped to (ls, l).
          * We can use a nested hashmap for that --> vectorclocks_collected[ls][l] would return all possible acq(l) VCs for (ls, l).
          */
-        std::set<ResourceName> lockset = {};
-        std::map<std::set<ResourceName>, std::unordered_map<ResourceName,
-                                                            std::deque<VectorClock>>>
-            vectorclocks_collected;
+        LockSetID lockset = LockSetTable::EMPTY;
+        std::map<LockSetID, std::unordered_map<LockIndex, std::deque<Clock>>> vectorclocks_collected;
         // H(y)
         std::unordered_map<ResourceName, std::deque<std::shared_ptr<EpochVCPair>>> history = {};
         // Th(i)
-        VectorClock vector_clock = {};
+        Clock vector_clock = {};
         std::unordered_map<ResourceName, TracePosition> last_read_merges = {};
         std::unordered_map<ResourceName, TracePosition> lock_acquired_at = {};
         TracePosition last_write_at = 0;
@@ -77,26 +124,38 @@ private:
         // Acq(y)
         Epoch last_acquire = {};
         // L_w(x)
-        VectorClock last_write_vc = {};
+        Clock last_write_vc = {};
         // L_wt(x)
         ThreadID last_write_thread = {};
         // L_wl(x)
-        std::set<ResourceName> last_write_ls = {};
+        LockSetID last_write_ls = LockSetTable::EMPTY;
         // Helper variable, we need to check if write already occured,
         // but defaults stored in last_* variables don't tell us.
         bool last_write_occured = false;
         TracePosition last_write_occured_at = 0;
     };
 
-    std::unordered_map<ThreadID, Thread> threads = {};
+    SlotTable<Thread> threads = {};
     std::unordered_map<ResourceName, Resource> resources = {};
-    std::unordered_map<ResourceName, VectorClock> notifies = {};
+    std::unordered_map<ResourceName, Clock> notifies = {};
     // We don't know about all threads at the beginning, so we have to save a global history in order to load it into a newly spawned thread.
     // This history is still optimized for limited size.
     std::unordered_map<ResourceName, std::deque<std::shared_ptr<EpochVCPair>>>
         global_history = {};
     // Global lockset for guard lock detection
-    std::set<ResourceName> lockset_global = {};
+    LockSet lockset_global = {};
+    SlotMap lock_slots;
+    LockSetTable locksets = {};
+    LockGraph lock_graph = {};
+    DependencyIndex<DependencyClocks> dependency_index = {};
+    // Checkpoint of find_cycles: the starts not reported to the end yet, valid until the next acquire changes the clocks
+    std::vector<LockDependency> starts = {};
+    std::vector<PendingStart> pending_starts = {};
+    bool search_prepared = false;
+    // Whether the chain length limit kept a chain from being searched
+    bool chains_cut = false;
+    // With unique_cycles or identify_cycles: every cycle reported so far
+    CycleSet reported_cycles = {};
 
     /**
      * We have a thread-local history, but other threads need to "know" what happened before they are first encountered,
@@ -104,8 +163,8 @@ private:
      */
     Thread *get_thread(ThreadID thread_id)
     {
-        auto current_thread_ptr = threads.find(thread_id);
-        if (current_thread_ptr == threads.end())
+        Thread *current_thread = threads.find(thread_id);
+        if (current_thread == nullptr)
         {
             std::unordered_map<ResourceName, std::deque<std::shared_ptr<EpochVCPair>>> new_history = {};
             for (auto history_pair : global_history)
@@ -113,21 +172,20 @@ private:
                 new_history[history_pair.first] = history_pair.second;
             }
 
-            return &threads.insert({thread_id,
-                                    Thread{
-                                        thread_id,
-                                        {},
-                                        {},
-                                        new_history,
-                                        VectorClock(thread_id),
-                                        {},
-                                        {},
-                                        0}})
-                        .first->second;
+            return threads.insert(thread_id,
+                                  Thread{
+                                      thread_id,
+                                      {},
+                                      {},
+                                      new_history,
+                                      Clock(thread_id),
+                                      {},
+                                      {},
+                                      0});
         }
         else
         {
-            return &current_thread_ptr->second;
+            return current_thread;
         }
     }
 
@@ -144,16 +202,19 @@ private:
         }
     }
 
-    void insert_vectorclock_into_thread(Thread *thread, VectorClock *vc, std::set<ResourceName> *ls, ResourceName l)
+    void insert_vectorclock_into_thread(Thread *thread, Clock *vc, LockSetID ls, LockIndex l)
     {
 #ifdef COLLECT_STATISTICS
-        pwrundead_size_of_all_locksets_count += ls->size();
+        pwrundead_size_of_all_locksets_count += locksets.get(ls).size();
 #endif
 
-        auto ls_map = thread->vectorclocks_collected.find(*ls);
+        // The clocks of the dependencies change, a checkpoint of the search no longer applies
+        search_prepared = false;
+
+        auto ls_map = thread->vectorclocks_collected.find(ls);
         if (ls_map == thread->vectorclocks_collected.end())
         {
-            ls_map = thread->vectorclocks_collected.insert({*ls, {}}).first;
+            ls_map = thread->vectorclocks_collected.insert({ls, {}}).first;
         }
 
         auto l_map = ls_map->second.find(l);
@@ -162,11 +223,12 @@ private:
             l_map = ls_map->second.insert({l, {}}).first;
 
 #ifdef COLLECT_STATISTICS
-            undead_size_of_all_locksets_count += ls->size();
+            undead_size_of_all_locksets_count += locksets.get(ls).size();
 #endif
         }
 
-        if (l_map->second.size() >= this->VECTOR_CLOCKS_PER_DEPENDENCY_LIMIT)
+        // The newest clock is always kept, also with a limit of 0
+        if (!l_map->second.empty() && l_map->second.size() >= config.vector_clocks_per_dependency)
         {
             l_map->second.pop_front();
         }
@@ -175,12 +237,7 @@ private:
 
     bool isCycleChain(std::vector<LockDependency> *chain_stack, LockDependency *dependency)
     {
-        for (auto &chain_dep_ls : *chain_stack->front().lockset)
-        {
-            if (chain_dep_ls == dependency->resource_name)
-                return true;
-        }
-        return false;
+        return chain_stack->front().lockset->contains(dependency->lock);
     }
 
     bool isChain(std::vector<LockDependency> *chain_stack, LockDependency *dependency)
@@ -188,25 +245,14 @@ private:
         for (auto &chain_dep : *chain_stack)
         {
             // Check if (LD-3) l_n in ls_1
-            if (chain_dep.resource_name == dependency->resource_name)
+            if (chain_dep.lock == dependency->lock)
                 return false;
             // Check if (LD-1) LS(ls_i) cap LS(ls_j)
-            for (auto &chain_dep_ls : *chain_dep.lockset)
-            {
-                for (auto &dependency_ls : *dependency->lockset)
-                {
-                    if (chain_dep_ls == dependency_ls)
-                        return false;
-                }
-            }
+            if (chain_dep.lockset->overlaps(*dependency->lockset))
+                return false;
         }
         // Check if (LD-2) l_i in ls_i+1 for i=1,...,n-1
-        for (auto &dependency_ls : *dependency->lockset)
-        {
-            if (chain_stack->back().resource_name == dependency_ls)
-                return true;
-        }
-        return false;
+        return dependency->lockset->contains(chain_stack->back().lock);
     }
 
     bool isChainVC(std::vector<LockDependency> *chain_stack, LockDependency *dependency)
@@ -224,76 +270,158 @@ private:
         return true;
     }
 
-    void dfs(std::vector<LockDependency> *chain_stack, int visiting_thread_id,
-             std::unordered_map<ThreadID, bool> *is_traversed, std::set<ThreadID> *thread_ids)
+    bool within_chain_length(size_t length) const
+    {
+        return config.max_chain_length == 0 || length <= config.max_chain_length;
+    }
+
+    // Whether a candidate on the same level with the thread and lock of candidate closed a cycle, candidate can only
+    // close the same one.
+    bool repeats_closed(const std::vector<const DependencyClocks *> &closed, const DependencyClocks &candidate) const
     {
-        for (auto thread_id = thread_ids->cbegin(); thread_id != thread_ids->cend(); ++thread_id)
+        for (auto *other : closed)
         {
-            if (*thread_id <= visiting_thread_id)
-                continue;
-            Thread *thread = get_thread(*thread_id);
-            if (thread->vectorclocks_collected.empty())
-                continue;
+            if (other->id == candidate.id && other->lock == candidate.lock)
+                return true;
+        }
+        return false;
+    }
+
+    // Returns false if the budget interrupted the search, search->path then holds the (candidate, clock) positions of
+    // the chain to resume from, outermost first.
+    bool dfs(CycleSearch *search, int visiting_thread_id, SearchBudget *budget, StartResult *result)
+    {
+        std::vector<LockDependency> *chain_stack = &search->chain_stack;
+        std::vector<bool> *is_traversed = &search->is_traversed;
+        // A chain at the length limit can neither close nor grow, its candidates aren't worth a look
+        if (!within_chain_length(chain_stack->size() + 1))
+        {
+            search->chains_cut = true;
+            return true;
+        }
+
+        // A resumed search skips to where it stopped, on the levels above that it re-enters the chain it was extending
+        size_t level = chain_stack->size() - 1;
+        size_t first = 0;
+        size_t first_vc = 0;
+        bool is_reentering = false;
+        if (2 * level < search->resume.size())
+        {
+            first = search->resume[2 * level];
+            first_vc = search->resume[2 * level + 1];
+            is_reentering = 2 * level + 2 < search->resume.size();
+            if (!is_reentering)
+                search->resume.clear();
+        }
+        std::vector<const DependencyClocks *> *closed = nullptr;
+        if (config.unique_cycles)
+        {
+            closed = &search->closed[level];
+            closed->clear();
+        }
+
+        // A cycle stays within the component of its first lock
+        int component = lock_graph.component(chain_stack->front().lock);
+        // Only dependencies holding the last lock of the chain can extend it (LD-2)
+        auto candidates = dependency_index.holding_after(chain_stack->back().lock, visiting_thread_id);
+        for (auto candidate = candidates.begin() + first; candidate != candidates.end(); ++candidate)
+        {
+            size_t position = candidate - candidates.begin();
+            bool is_first = true;
+            bool is_cycle_chain = false;
+            size_t vc_index = 0;
+            if (is_reentering)
+            {
+                // Passed LD-1 to LD-3 and didn't close the cycle before the search stopped
+                is_first = false;
+                vc_index = first_vc;
+            }
+            else
+            {
+                if (!budget->explore(&search->states))
+                {
+                    search->path.insert(search->path.begin(), {position, 0});
+                    return false;
+                }
+                if ((*is_traversed)[candidate->id] || lock_graph.component(candidate->lock) != component)
+                    continue;
+                if (closed != nullptr && repeats_closed(*closed, *candidate))
+                {
+                    search->skipped_candidates++;
+                    continue;
+                }
+            }
 
-            if (!is_traversed->find(*thread_id)->second)
+            for (auto vc = candidate->vector_clocks->begin() + vc_index; vc != candidate->vector_clocks->end(); ++vc)
             {
-                for (auto &d : thread->vectorclocks_collected)
+                LockDependency dependency = LockDependency{
+                    candidate->id,
+                    candidate->lock,
+                    &*vc,
+                    candidate->lockset};
+
+                // If it's not a valid chain for conditions LD-1 to LD-3, we don't have to check the other VC deps
+                if (is_first)
+                {
+                    if (!isChain(chain_stack, &dependency))
+                    {
+                        break;
+                    }
+                    is_cycle_chain = isCycleChain(chain_stack, &dependency);
+                    is_first = false;
+                }
+
+                // Only check for LD-4, we already checked for the previous ones
+                if (is_reentering || isChainVC(chain_stack, &dependency))
                 {
-                    for (auto &l : d.second)
+                    if (is_cycle_chain)
                     {
-                        bool is_first = true;
-                        bool is_cycle_chain = false;
-                        for (auto &vc : l.second)
+                        DataRace race{lock_slots.key(dependency.lock), 0, chain_stack->front().id, dependency.id};
+                        if (closed == nullptr)
+                        {
+                            if (config.identify_cycles)
+                                result->cycles.push_back(CycleSet::key_of(*chain_stack, dependency));
+                            result->races.push_back(race);
+                            continue;
+                        }
+                        // The other clocks close the same cycle
+                        closed->push_back(&*candidate);
+                        CycleSet::Key key = CycleSet::key_of(*chain_stack, dependency);
+                        if (search->cycles.insert(key))
                         {
-                            LockDependency dependency = LockDependency{
-                                *thread_id,
-                                l.first,
-                                &vc,
-                                &d.first};
-
-                            // If it's not a valid chain for conditions LD-1 to LD-3, we don't have to check the other VC deps
-                            if (is_first)
-                            {
-                                if (!isChain(chain_stack, &dependency))
-                                {
-                                    break;
-                                }
-                                is_cycle_chain = isCycleChain(chain_stack, &dependency);
-                                is_first = false;
-                            }
-
-                            // Only check for LD-4, we already checked for the previous ones
-                            if (isChainVC(chain_stack, &dependency))
-                            {
-                                if (is_cycle_chain)
-                                {
-                                    this->lockframe->report_race(
-                                        DataRace{dependency.resource_name, 0, chain_stack->front().id,
-                                                 dependency.id});
-                                }
-                                else
-                                {
-                                    (*is_traversed)[*thread_id] = true;
-                                    chain_stack->push_back(dependency);
-                                    dfs(chain_stack, visiting_thread_id, is_traversed, thread_ids);
-                                    chain_stack->pop_back();
-                                    (*is_traversed)[*thread_id] = false;
-                                }
-                            }
+                            result->races.push_back(race);
+                            result->cycles.push_back(std::move(key));
+                        }
+                        break;
+                    }
+                    else
+                    {
+                        is_reentering = false;
+                        (*is_traversed)[candidate->id] = true;
+                        chain_stack->push_back(dependency);
+                        bool is_done = dfs(search, visiting_thread_id, budget, result);
+                        chain_stack->pop_back();
+                        (*is_traversed)[candidate->id] = false;
+                        if (!is_done)
+                        {
+                            size_t clock = vc - candidate->vector_clocks->begin();
+                            search->path.insert(search->path.begin(), {position, clock});
+                            return false;
                         }
                     }
                 }
             }
         }
+        return true;
     }
 
     // This function was originally called w3 in the paper.
     // In the mean time, the algorithm was renamed from w3po to PWR.
     void pwr_history_sync(Thread *thread, Resource *resource)
     {
-        for (ResourceName lock : thread->lockset)
+        for (LockIndex lock : locksets.get(thread->lockset))
         {
-            auto current_history_iter = thread->history.find(lock);
+            auto current_history_iter = thread->history.find(lock_slots.key(lock));
             if (current_history_iter == thread->history.end())
                 continue;
             auto current_history = &current_history_iter->second;
@@ -369,43 +497,143 @@ private:
         return false;
     }
 
-    void find_cycles()
+    void prepare_search()
     {
-        std::set<ThreadID> thread_ids = {};
-        std::unordered_map<ThreadID, bool> is_traversed = {};
-        for (auto const &thread : threads)
+        lock_graph = {};
+        for (auto &thread : threads)
         {
-            thread_ids.insert(thread.first);
-            is_traversed[thread.first] = false;
+            for (auto &d : thread.vectorclocks_collected)
+            {
+                for (auto &l : d.second)
+                {
+                    lock_graph.add_dependency(locksets.get(d.first), l.first);
+                }
+            }
         }
+        lock_graph.find_components();
 
-        int visiting;
-        std::vector<LockDependency> chain_stack = {};
-        for (auto thread_id = thread_ids.cbegin(); thread_id != thread_ids.cend(); ++thread_id)
+        // Every (dependency, clock) that may be part of a deadlock starts a search of its own and can extend the chains
+        // of others.
+        starts.clear();
+        dependency_index.clear();
+        for (auto &thread : threads)
         {
-            Thread *thread = get_thread(*thread_id);
-            if (thread->vectorclocks_collected.empty())
-                continue;
-            visiting = *thread_id;
-
-            for (auto &d : thread->vectorclocks_collected)
+            for (auto &d : thread.vectorclocks_collected)
             {
                 for (auto &l : d.second)
                 {
+                    if (!lock_graph.may_deadlock(locksets.get(d.first), l.first))
+                        continue;
+                    dependency_index.add(locksets.get(d.first),
+                                         DependencyClocks{thread.thread_id, l.first, &l.second, &locksets.get(d.first)});
                     for (auto &vc : l.second)
                     {
-                        is_traversed[*thread_id] = true;
-                        chain_stack.push_back(LockDependency{
-                            *thread_id,
+                        starts.push_back(LockDependency{
+                            thread.thread_id,
                             l.first,
                             &vc,
-                            &d.first});
-                        dfs(&chain_stack, visiting, &is_traversed, &thread_ids);
-                        chain_stack.pop_back();
+                            &locksets.get(d.first)});
                     }
                 }
             }
         }
+
+        pending_starts.clear();
+        for (size_t i = 0; i < starts.size(); i++)
+        {
+            pending_starts.push_back(PendingStart{i, {}, false, {}});
+        }
+        chains_cut = false;
+        search_prepared = true;
+
+#ifdef COLLECT_STATISTICS
+        this->lockframe->report_statistic("Lock graph components with cycles", lock_graph.size());
+        this->lockframe->report_statistic("Phase 2 start dependencies", starts.size());
+#endif
+    }
+
+    void find_cycles()
+    {
+        if (!search_prepared)
+            prepare_search();
+
+        // The searches only read the dependencies and run on the worker threads.
+        SearchBudget budget(config);
+        CycleSearch prototype = {};
+        prototype.is_traversed.assign(threads.capacity(), false);
+        // A chain has a dependency per thread at most
+        prototype.closed.resize(threads.capacity() + 1);
+        std::vector<CycleSearch> searches(std::max<size_t>(config.worker_threads, 1), prototype);
+        run_tasks(pending_starts.size(), searches.size(), [&](size_t task, size_t worker) {
+            PendingStart &pending = pending_starts[task];
+            if (pending.is_finished || budget.exhausted())
+                return;
+            CycleSearch &search = searches[worker];
+            const LockDependency &start = starts[pending.start];
+            ThreadID visiting = start.id;
+            search.is_traversed[visiting] = true;
+            search.chain_stack.push_back(start);
+            search.resume = std::move(pending.path);
+            search.path.clear();
+            search.cycles.clear();
+            pending.is_finished = dfs(&search, visiting, &budget, &pending.found);
+            pending.path = std::move(search.path);
+            search.chain_stack.pop_back();
+            search.is_traversed[visiting] = false;
+        });
+
+        // Reported in the order of the starts, as a single thread would find them: up to the first interrupted start,
+        // the starts after it keep what they found for the next call, which continues where the searches stopped.
+        std::vector<PendingStart> unfinished = {};
+        bool in_order = true;
+        for (size_t task = 0; task < pending_starts.size(); task++)
+        {
+            PendingStart &pending = pending_starts[task];
+            if (in_order)
+            {
+                StartResult &result = pending.found;
+                for (size_t i = 0; i < result.races.size(); i++)
+                {
+                    // Other starts may have found the cycle as well, the first one reports it
+                    if (config.unique_cycles && !reported_cycles.insert(result.cycles[i]))
+                        continue;
+                    if (config.identify_cycles)
+                        result.races[i].cycle = reported_cycles.id_of(result.cycles[i]);
+                    this->lockframe->report_race(result.races[i]);
+                }
+                result = {};
+                in_order = pending.is_finished;
+            }
+            if (!in_order)
+            {
+                unfinished.push_back(std::move(pending));
+            }
+        }
+        pending_starts = std::move(unfinished);
+        for (auto &search : searches)
+        {
+            chains_cut = chains_cut || search.chains_cut;
+        }
+
+#ifdef COLLECT_STATISTICS
+        size_t explored_states = 0;
+        for (auto &search : searches)
+        {
+            explored_states += search.states;
+        }
+        this->lockframe->report_statistic("Phase 2 explored states", explored_states);
+        if (config.unique_cycles)
+        {
+            size_t skipped_candidates = 0;
+            for (auto &search : searches)
+            {
+                skipped_candidates += search.skipped_candidates;
+            }
+            this->lockframe->report_statistic("Phase 2 candidates repeating a searched one", skipped_candidates);
+            this->lockframe->report_statistic("Unique cycles", reported_cycles.size());
+        }
+        this->lockframe->report_statistic("Phase 2 pending start dependencies", pending_starts.size());
+#endif
     }
 
 public:
@@ -463,15 +691,16 @@ public:
 
         pwr_history_sync(thread, resource);
 
+        LockIndex lock = lock_slots.slot(resource_name);
         insert_vectorclock_into_thread(
             thread,
             &thread->vector_clock,
-            &thread->lockset,
-            resource_name);
+            thread->lockset,
+            lock);
 
-        // Add Resource to Lockset, using std::set can't add multiple times
-        thread->lockset.insert(resource_name);
-        this->lockset_global.insert(resource_name);
+        // Add Resource to Lockset
+        thread->lockset = locksets.with(thread->lockset, lock);
+        this->lockset_global.insert(lock);
 
         // Set acquire History
         resource->last_acquire = Epoch{thread_id, thread->vector_clock.find(thread_id)};
@@ -489,31 +718,32 @@ public:
         pwr_history_sync(thread, resource);
 
         // Remove Resource from Lockset
-        thread->lockset.erase(resource_name);
-        this->lockset_global.erase(resource_name);
+        LockIndex lock = lock_slots.slot(resource_name);
+        thread->lockset = locksets.without(thread->lockset, lock);
+        this->lockset_global.erase(lock);
 
         auto lock_acquired_at = thread->lock_acquired_at.find(resource_name);
 
         // Add to history
         // Adds EpochVCPair to thread's history and global history.
-        // Limits history size per mutex to THREAD_HISTORY_SIZE (see at top of file).
-        if (lock_acquired_at != thread->lock_acquired_at.end() && lock_acquired_at->second < thread->last_write_at)
+        // Limits history size per mutex to config.history_size.
+        if (config.history_size > 0 && lock_acquired_at != thread->lock_acquired_at.end() && lock_acquired_at->second < thread->last_write_at)
         {
             std::shared_ptr<EpochVCPair> shared_epoch_vc_pair = std::shared_ptr<EpochVCPair>(new EpochVCPair{
                 resource->last_acquire,
                 thread->vector_clock});
             for (auto thread_iter = threads.begin(); thread_iter != threads.end(); ++thread_iter)
             {
-                if (thread_iter->first == thread_id)
+                if (thread_iter->thread_id == thread_id)
                 {
                     continue;
                 }
 
-                auto current_history = &thread_iter->second.history.emplace(std::piecewise_construct,
+                auto current_history = &thread_iter->history.emplace(std::piecewise_construct,
                                                                             std::forward_as_tuple(resource_name),
                                                                             std::forward_as_tuple())
                                             .first->second;
-                if (current_history->size() >= THREAD_HISTORY_SIZE)
+                if (current_history->size() >= config.history_size)
                 {
                     current_history->pop_back();
                 }
@@ -524,7 +754,7 @@ public:
                                                                   std::forward_as_tuple(resource_name),
                                                                   std::forward_as_tuple())
                                                .first->second;
-            if (current_global_history->size() >= THREAD_HISTORY_SIZE)
+            if (current_global_history->size() >= config.history_size)
             {
                 current_global_history->pop_back();
             }
@@ -539,7 +769,9 @@ public:
         Thread *thread = get_thread(thread_id);
         Thread *target_thread = get_thread(target_thread_id);
 
-        target_thread->vector_clock = thread->vector_clock;
+        // The target may already be running (e.g. a signalled thread), it joins the parent's clock and keeps its own
+        // history, which also keeps the versions of a tree clock growing.
+        target_thread->vector_clock.merge_into(&thread->vector_clock);
         target_thread->vector_clock.increment(target_thread_id);
 
         thread->vector_clock.increment(thread_id);
@@ -562,11 +794,11 @@ public:
         auto notifies_iter = notifies.find(resource_name);
         if (notifies_iter == notifies.end())
         {
-            notifies_iter = notifies.insert({resource_name, VectorClock()}).first;
+            notifies_iter = notifies.insert({resource_name, Clock()}).first;
         }
 
-        notifies_iter->second.merge_into(&thread->vector_clock);
         thread->vector_clock.merge_into(&notifies_iter->second);
+        notifies_iter->second = thread->vector_clock;
 
         thread->vector_clock.increment(thread_id);
     }
@@ -588,6 +820,11 @@ public:
         notifies[resource_name] = thread->vector_clock;
     }
 
+    void process_batch(const Event *events, size_t count) override
+    {
+        dispatch_events(this, events, count);
+    }
+
     void get_races()
     {
 #ifdef COLLECT_STATISTICS
@@ -596,11 +833,11 @@ public:
         size_t pwrundead_dependency_count = 0;
         std::vector<size_t> pwrundead_dependency_per_thread_count = {};
 
-        for (auto i : threads)
+        for (auto &thread : threads)
         {
             size_t dep_counter = 0;
             size_t vc_dep_counter = 0;
-            for (auto &d : i.second.vectorclocks_collected)
+            for (auto &d : thread.vectorclocks_collected)
             {
                 for (auto &l : d.second)
                 {
@@ -647,4 +884,9 @@ public:
                                               std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()));
 #endif
     }
+
+    bool is_complete() const override
+    {
+        return pending_starts.empty() && !chains_cut;
+    }
 };
\ No newline at end of file
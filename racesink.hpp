@@ -0,0 +1,261 @@
+#ifndef RACESINK_H
+#define RACESINK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "lockframe_types.hpp"
+
+/**
+ * Receives the races of a LockFrame as the detector finds them, with the trace's ThreadIDs.
+ * finish() is called by LockFrame::get_races once the detector concluded and may be called more than once.
+ */
+class RaceSink {
+    public:
+        virtual ~RaceSink() = default;
+        virtual void report(const DataRace &race) = 0;
+        virtual void finish() {}
+};
+
+// Keeps every race, what LockFrame does when no sink is set.
+class VectorRaceSink : public RaceSink {
+    public:
+        std::vector<DataRace> races = {};
+
+        void report(const DataRace &race) override {
+            races.push_back(race);
+        }
+};
+
+class CallbackRaceSink : public RaceSink {
+    public:
+        explicit CallbackRaceSink(std::function<void(const DataRace &)> callback) : callback(std::move(callback)) {}
+
+        void report(const DataRace &race) override {
+            callback(race);
+        }
+
+    private:
+        std::function<void(const DataRace &)> callback;
+};
+
+// Keeps only the last capacity races, memory stays bounded however many are reported.
+class RingRaceSink : public RaceSink {
+    public:
+        explicit RingRaceSink(size_t capacity) : ring(capacity) {}
+
+        void report(const DataRace &race) override {
+            if(!ring.empty()) {
+                ring[reported_races % ring.size()] = race;
+            }
+            reported_races++;
+        }
+
+        // All races reported so far, including the overwritten ones.
+        size_t reported() const {
+            return reported_races;
+        }
+
+        // The kept races, oldest first.
+        std::vector<DataRace> races() const {
+            std::vector<DataRace> kept = {};
+            size_t count = reported_races < ring.size() ? reported_races : ring.size();
+            for(size_t i = reported_races - count; i < reported_races; i++) {
+                kept.push_back(ring[i % ring.size()]);
+            }
+            return kept;
+        }
+
+    private:
+        std::vector<DataRace> ring;
+        size_t reported_races = 0;
+};
+
+// One line per race, the format of the reader's outputs.
+inline void write_race(std::ostream &output, const DataRace &race, bool csv) {
+    if(csv) {
+        // THREAD1, THREAD2, RESOURCENAME, TRACELINE
+        output << race.thread_id_1 << ',' << race.thread_id_2 << ',' << race.resource_name << ','
+               << race.trace_position << '\n';
+    } else {
+        // original format established by Jan Metzger.
+        output << 'T' << race.thread_id_1 << " <--> T" << race.thread_id_2 << ", Resource: ["
+               << race.resource_name << "], Line: " << race.trace_position << '\n';
+    }
+}
+
+// Writes races to a stream as they are reported, flushed on finish().
+class StreamRaceSink : public RaceSink {
+    public:
+        StreamRaceSink(std::ostream *output, bool csv) : output(output), csv(csv) {}
+
+        void report(const DataRace &race) override {
+            write_race(*output, race, csv);
+        }
+
+        void finish() override {
+            output->flush();
+        }
+
+    private:
+        std::ostream *output;
+        bool csv;
+};
+
+// Writes races to a file while the detector runs, through a large buffer so the disk sees few big writes.
+class FileRaceSink : public RaceSink {
+    public:
+        FileRaceSink(const std::string &path, bool csv) : buffer(1 << 20), csv(csv) {
+            // The buffer has to be set before the file is opened to take effect.
+            file.rdbuf()->pubsetbuf(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            file.open(path, std::ios::trunc);
+        }
+
+        bool good() const {
+            return file.good();
+        }
+
+        void report(const DataRace &race) override {
+            write_race(file, race, csv);
+        }
+
+        void finish() override {
+            file.flush();
+        }
+
+    private:
+        std::vector<char> buffer;
+        std::ofstream file;
+        bool csv;
+};
+
+/**
+ * What makes two reported races the same bug for a RaceAggregator. Thread pairs are unordered.
+ * Deadlocks are reported with the lock closing the cycle as resource and the first and last thread of the chain,
+ * so RESOURCE_AND_THREAD_PAIR folds the orderings and clock combinations of one cycle into one entry.
+ * LOCK_CYCLE folds all reports of a cycle, whatever lock and threads they name, by the cycle id the detectors set with
+ * DetectorConfig::identify_cycles. Races without a cycle are aggregated by resource and thread pair.
+ */
+enum class RaceAggregationKey {
+    RESOURCE,
+    THREAD_PAIR,
+    RESOURCE_AND_THREAD_PAIR,
+    LOCK_CYCLE
+};
+
+struct AggregatedRace {
+    // The first report of the key, later ones only update the last position and the count.
+    DataRace first;
+    TracePosition last_position;
+    size_t count;
+};
+
+/**
+ * Deduplicates races online, memory and output grow with the number of distinct keys instead of reports.
+ * Distinct races are found through an open addressing table of indices into the aggregated races.
+ */
+class RaceAggregator : public RaceSink {
+    public:
+        explicit RaceAggregator(RaceAggregationKey key) : key(key), table(16, 0) {}
+
+        void report(const DataRace &race) override {
+            DataRace race_key = key_of(race);
+            size_t mask = table.size() - 1;
+            for(size_t i = hash(race_key) & mask;; i = (i + 1) & mask) {
+                if(table[i] == 0) {
+                    aggregated_races.push_back(AggregatedRace{race, race.trace_position, 1});
+                    table[i] = static_cast<uint32_t>(aggregated_races.size());
+                    if(aggregated_races.size() * 2 > table.size()) {
+                        grow();
+                    }
+                    return;
+                }
+                AggregatedRace &aggregated = aggregated_races[table[i] - 1];
+                if(same_key(key_of(aggregated.first), race_key)) {
+                    aggregated.last_position = race.trace_position;
+                    aggregated.count++;
+                    return;
+                }
+            }
+        }
+
+        // Distinct races in the order they were first reported.
+        const std::vector<AggregatedRace> &races() const {
+            return aggregated_races;
+        }
+
+    private:
+        RaceAggregationKey key;
+        // 1-based indices into aggregated_races, 0 marks a free bucket. The size is a power of two.
+        std::vector<uint32_t> table;
+        std::vector<AggregatedRace> aggregated_races = {};
+
+        // The fields of race that make up the key, the others are 0.
+        DataRace key_of(const DataRace &race) const {
+            bool ordered = race.thread_id_1 <= race.thread_id_2;
+            ThreadID thread_1 = ordered ? race.thread_id_1 : race.thread_id_2;
+            ThreadID thread_2 = ordered ? race.thread_id_2 : race.thread_id_1;
+            switch(key) {
+                case RaceAggregationKey::RESOURCE:
+                    return DataRace{race.resource_name, 0, 0, 0};
+                case RaceAggregationKey::THREAD_PAIR:
+                    return DataRace{0, 0, thread_1, thread_2};
+                case RaceAggregationKey::LOCK_CYCLE:
+                    if(race.cycle != 0) {
+                        return DataRace{0, 0, 0, 0, race.cycle};
+                    }
+                    return DataRace{race.resource_name, 0, thread_1, thread_2};
+                default:
+                    return DataRace{race.resource_name, 0, thread_1, thread_2};
+            }
+        }
+
+        static bool same_key(const DataRace &a, const DataRace &b) {
+            return a.resource_name == b.resource_name && a.thread_id_1 == b.thread_id_1 && a.thread_id_2 == b.thread_id_2 &&
+                   a.cycle == b.cycle;
+        }
+
+        static size_t hash(const DataRace &race_key) {
+            uint64_t value = (static_cast<uint32_t>(race_key.resource_name) ^ static_cast<uint64_t>(race_key.cycle) << 32) *
+                             0x9E3779B97F4A7C15ULL;
+            value ^= static_cast<uint64_t>(static_cast<uint32_t>(race_key.thread_id_1)) << 32
+                     | static_cast<uint32_t>(race_key.thread_id_2);
+            value ^= value >> 31;
+            value *= 0xBF58476D1CE4E5B9ULL;
+            value ^= value >> 29;
+            return static_cast<size_t>(value);
+        }
+
+        void grow() {
+            table.assign(table.size() * 2, 0);
+            size_t mask = table.size() - 1;
+            for(size_t index = 0; index < aggregated_races.size(); index++) {
+                size_t i = hash(key_of(aggregated_races[index].first)) & mask;
+                while(table[i] != 0) {
+                    i = (i + 1) & mask;
+                }
+                table[i] = static_cast<uint32_t>(index + 1);
+            }
+        }
+};
+
+// Like write_race, with the last position and the number of reports appended.
+inline void write_aggregated_race(std::ostream &output, const AggregatedRace &race, bool csv) {
+    const DataRace &first = race.first;
+    if(csv) {
+        // THREAD1, THREAD2, RESOURCENAME, FIRST TRACELINE, LAST TRACELINE, COUNT
+        output << first.thread_id_1 << ',' << first.thread_id_2 << ',' << first.resource_name << ','
+               << first.trace_position << ',' << race.last_position << ',' << race.count << '\n';
+    } else {
+        output << 'T' << first.thread_id_1 << " <--> T" << first.thread_id_2 << ", Resource: ["
+               << first.resource_name << "], Line: " << first.trace_position << ", Last line: " << race.last_position
+               << ", Count: " << race.count << '\n';
+    }
+}
+
+#endif
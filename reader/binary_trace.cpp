@@ -0,0 +1,151 @@
+#include "binary_trace.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_set>
+#include <vector>
+
+// Converts between the host byte order and the little endian one of the format, either way. No-ops on little endian
+// hosts.
+static uint32_t little_endian(uint32_t value) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_bswap32(value);
+#else
+    return value;
+#endif
+}
+
+static uint64_t little_endian(uint64_t value) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_bswap64(value);
+#else
+    return value;
+#endif
+}
+
+static int32_t little_endian(int32_t value) {
+    return static_cast<int32_t>(little_endian(static_cast<uint32_t>(value)));
+}
+
+static BinaryTraceHeader little_endian(BinaryTraceHeader header) {
+    header.version = little_endian(header.version);
+    header.flags = little_endian(header.flags);
+    header.event_count = little_endian(header.event_count);
+    header.thread_count = little_endian(header.thread_count);
+    header.lock_count = little_endian(header.lock_count);
+    header.resource_count = little_endian(header.resource_count);
+    header.reserved = little_endian(header.reserved);
+    return header;
+}
+
+static BinaryTraceRecord little_endian(BinaryTraceRecord record) {
+    record.thread_id = little_endian(record.thread_id);
+    record.target = little_endian(record.target);
+    record.event_type = little_endian(record.event_type);
+    return record;
+}
+
+bool is_binary_trace(const char *begin, const char *end) {
+    return begin != nullptr && end - begin >= static_cast<ptrdiff_t>(sizeof(BINARY_TRACE_MAGIC))
+           && memcmp(begin, BINARY_TRACE_MAGIC, sizeof(BINARY_TRACE_MAGIC)) == 0;
+}
+
+BinaryTraceParser::BinaryTraceParser(const char *begin, const char *end) : position(begin), end(end) {
+    if (!is_binary_trace(begin, end) || end - begin < static_cast<ptrdiff_t>(sizeof(BinaryTraceHeader))) {
+        throw std::invalid_argument("Not a binary trace");
+    }
+    memcpy(&trace_header, begin, sizeof(BinaryTraceHeader));
+    trace_header = little_endian(trace_header);
+    if (trace_header.version != BINARY_TRACE_VERSION) {
+        throw std::invalid_argument("Unsupported binary trace version " + std::to_string(trace_header.version));
+    }
+    position += sizeof(BinaryTraceHeader);
+    if (static_cast<uint64_t>(end - position) != trace_header.event_count * sizeof(BinaryTraceRecord)) {
+        throw std::invalid_argument("Binary trace is truncated");
+    }
+}
+
+bool BinaryTraceParser::next(TraceLine *trace_line) {
+    if (position >= end) {
+        return false;
+    }
+
+    BinaryTraceRecord record;
+    memcpy(&record, position, sizeof(BinaryTraceRecord));
+    position += sizeof(BinaryTraceRecord);
+    record = little_endian(record);
+    if (record.event_type > static_cast<uint32_t>(TraceEventType::ATOMIC)) {
+        throw std::invalid_argument("Invalid event type");
+    }
+
+    trace_line->thread_id = record.thread_id;
+    trace_line->event_type = static_cast<TraceEventType>(record.event_type);
+    trace_line->target = record.target;
+    return true;
+}
+
+uint64_t convert_to_binary_trace(TraceParser *parser, bool speedygo_format, const std::filesystem::path &output_path) {
+    std::ofstream output(output_path, std::ios::binary | std::ios::trunc);
+    if (!output.good()) {
+        throw std::runtime_error("Cannot write " + output_path.string());
+    }
+
+    BinaryTraceHeader header = {};
+    memcpy(header.magic, BINARY_TRACE_MAGIC, sizeof(BINARY_TRACE_MAGIC));
+    header.version = BINARY_TRACE_VERSION;
+    header.flags = speedygo_format ? BINARY_TRACE_FLAG_SPEEDYGO : 0;
+    // Rewritten with the counts once all records are known
+    BinaryTraceHeader stored_header = little_endian(header);
+    output.write(reinterpret_cast<const char *>(&stored_header), sizeof(stored_header));
+
+    std::unordered_set<int> threads = {};
+    std::unordered_set<int> locks = {};
+    std::unordered_set<int> resources = {};
+    std::vector<BinaryTraceRecord> records = {};
+    const size_t RECORDS_PER_WRITE = 1 << 16;
+    records.reserve(RECORDS_PER_WRITE);
+
+    TraceLine trace_line;
+    while (parser->next(&trace_line)) {
+        threads.insert(trace_line.thread_id);
+        switch (trace_line.event_type) {
+            case TraceEventType::FORK:
+            case TraceEventType::JOIN:
+                // SpeedyGo signals target a signal id, not a thread
+                if (!speedygo_format) {
+                    threads.insert(trace_line.target);
+                }
+                break;
+            case TraceEventType::ACQUIRE:
+            case TraceEventType::RELEASE:
+                locks.insert(trace_line.target);
+                break;
+            default:
+                resources.insert(trace_line.target);
+                break;
+        }
+
+        records.push_back(little_endian(BinaryTraceRecord{trace_line.thread_id, trace_line.target,
+                                                          static_cast<uint32_t>(trace_line.event_type)}));
+        if (records.size() == RECORDS_PER_WRITE) {
+            output.write(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(BinaryTraceRecord));
+            header.event_count += records.size();
+            records.clear();
+        }
+    }
+    output.write(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(BinaryTraceRecord));
+    header.event_count += records.size();
+
+    header.thread_count = threads.size();
+    header.lock_count = locks.size();
+    header.resource_count = resources.size();
+    output.seekp(0);
+    stored_header = little_endian(header);
+    output.write(reinterpret_cast<const char *>(&stored_header), sizeof(stored_header));
+    output.close();
+    if (!output.good()) {
+        throw std::runtime_error("Cannot write " + output_path.string());
+    }
+    return header.event_count;
+}
@@ -0,0 +1,67 @@
+#ifndef BINARY_TRACE_H
+#define BINARY_TRACE_H
+
+#include <cstdint>
+#include <filesystem>
+#include "trace_parser.hpp"
+
+/**
+ * Binary trace format, written by reader --convert and detected by its magic when reading.
+ * A header is followed by event_count fixed width records in trace order, all little endian.
+ * Thread and resource names are stored as the ids the text parser assigned, so std traces don't need their
+ * name tables again. Signal semantics of SpeedyGo traces are kept in the header flags.
+ */
+const char BINARY_TRACE_MAGIC[8] = {'L', 'F', 'T', 'R', 'A', 'C', 'E', '\0'};
+const uint32_t BINARY_TRACE_VERSION = 1;
+const uint32_t BINARY_TRACE_FLAG_SPEEDYGO = 1;
+
+struct BinaryTraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t event_count;
+    // Distinct thread ids, lock ids (acquire/release targets) and other resource ids of the trace.
+    uint32_t thread_count;
+    uint32_t lock_count;
+    uint32_t resource_count;
+    uint32_t reserved;
+};
+
+struct BinaryTraceRecord {
+    int32_t thread_id;
+    int32_t target;
+    // TraceEventType
+    uint32_t event_type;
+};
+
+static_assert(sizeof(BinaryTraceHeader) == 40, "BinaryTraceHeader must not contain padding");
+static_assert(sizeof(BinaryTraceRecord) == 12, "BinaryTraceRecord must not contain padding");
+
+bool is_binary_trace(const char *begin, const char *end);
+
+/**
+ * Reads the records of a mapped binary trace, same interface as TraceParser.
+ */
+class BinaryTraceParser {
+public:
+    // Throws std::invalid_argument if the header is broken, of another version or the file is truncated.
+    BinaryTraceParser(const char *begin, const char *end);
+
+    bool next(TraceLine *trace_line);
+
+    const BinaryTraceHeader &header() const { return trace_header; }
+
+    // Records have no text, for error messages only.
+    std::string_view current_line() const { return "binary record"; }
+
+private:
+    BinaryTraceHeader trace_header = {};
+    const char *position;
+    const char *end;
+};
+
+// Writes all lines of parser as binary trace to output_path. Throws std::invalid_argument on malformed lines
+// (parser.current_line() holds the line) and std::runtime_error if the output can't be written.
+uint64_t convert_to_binary_trace(TraceParser *parser, bool speedygo_format, const std::filesystem::path &output_path);
+
+#endif
@@ -3,11 +3,13 @@
 #include <fstream>
 #include <vector>
 #include <chrono>
-#include <array>
 #include <unordered_map>
 #include <filesystem>
+#include <memory>
 #include <unistd.h>
 #include <iomanip>
+#include <cctype>
+#include <thread>
 #include "../lockframe.hpp"
 #include "../pwrdetector.hpp"
 #include "../undead.hpp"
@@ -21,6 +23,9 @@
 #include "../debug/pwr_remove_sync_equal.cpp"
 #include "../debug/pwr_dont_add_reads.cpp"
 #include "../lib/json.hpp"
+#include "trace_parser.hpp"
+#include "binary_trace.hpp"
+#include "spsc_queue.hpp"
 
 std::unordered_map<std::string, Detector *> detectors = {
         {"PWR",                new PWRDetector()},
@@ -39,72 +44,208 @@ bool is_detector_supported(const std::string &detector) {
     return detectors.find(detector) != detectors.end();
 }
 
-LockFrame *create_lockframe_with_detector(const std::string &detector) {
+template<typename D>
+LockFrame *create_static_lockframe(Detector *detector, const DetectorConfig &config) {
+    return new LockFrameT<D>(static_cast<D *>(detector), config);
+}
+
+// The built-in detectors are bound at compile time, the debug variants go through the virtual handlers.
+std::unordered_map<std::string, LockFrame *(*)(Detector *, const DetectorConfig &)> static_lockframes = {
+        {"PWR",            create_static_lockframe<PWRDetector>},
+        {"UNDEAD",         create_static_lockframe<UNDEADDetector>},
+        {"PWRUNDEAD",      create_static_lockframe<PWRUNDEADDetector>},
+        {"PWRUNDEADGuard", create_static_lockframe<PWRUNDEADGuardDetector>}};
+
+LockFrame *create_lockframe_with_detector(const std::string &detector, const DetectorConfig &config) {
+    auto static_lockframe = static_lockframes.find(detector);
+    if (static_lockframe != static_lockframes.end()) {
+        return static_lockframe->second(detectors.find(detector)->second, config);
+    }
     auto *lockFrame = new LockFrame();
-    lockFrame->set_detector(detectors.find(detector)->second);
+    lockFrame->set_detector(detectors.find(detector)->second, config);
     return lockFrame;
 }
 
-struct TraceLine {
-    int thread_id{};
-    std::string event_type;
-    int target{};
+// A detector fed from the trace, in --single-pass mode several of them share one pass.
+struct DetectorRun {
+    std::string name;
+    LockFrame *lockFrame;
+    // Time spent in the detector's event handlers
+    std::chrono::steady_clock::duration event_time{};
+    // Races are written out while the detector runs, except for stdout in --single-pass mode, which waits in
+    // deferred_races until the run is reported so the runs don't interleave.
+    std::vector<std::unique_ptr<RaceSink>> race_sinks = {};
+    VectorRaceSink *deferred_races = nullptr;
+    // With --aggregate the races only go here and are written out when the run is reported.
+    RaceAggregator *aggregator = nullptr;
 };
 
-std::unordered_map<int, int> signal_list = {};
-
-int std_lock_id_counter = 1;
-std::unordered_map<std::string, int> std_lock_id_map = {};
-int std_thread_counter = 1;
-std::unordered_map<std::string, int> std_thread_map = {};
-std::unordered_map<std::string, std::string> std_event_map = {
-        {"r",    "RD"},
-        {"w",    "WR"},
-        {"fork", "SIG"},
-        {"join", "WT"},
-        {"acq",  "LK"},
-        {"rel",  "UK"}};
-
-TraceLine convert_result_from_std(std::array<std::string, 3> *current_result) {
-    TraceLine result = {};
-
-    auto current_std_thread = std_thread_map.find(current_result->at(0));
-    if (current_std_thread == std_thread_map.end()) {
-        std_thread_map[current_result->at(0)] = std_thread_counter;
-        result.thread_id = std_thread_counter;
-        std_thread_counter += 1;
-    } else {
-        result.thread_id = current_std_thread->second;
+/**
+ * Turns parsed lines into LockFrame events, the line number becomes the trace position.
+ * In SpeedyGo traces a signal only remembers the signalling thread and a signal wait becomes a fork from it.
+ */
+class EventDecoder {
+public:
+    explicit EventDecoder(bool speedygo_format) : speedygo_format(speedygo_format) {}
+
+    const std::vector<Event> &decode(const TraceLine *batch, size_t count, int line_index) {
+        events.clear();
+        for (size_t i = 0; i < count; i++) {
+            const TraceLine &trace_line = batch[i];
+            int position = line_index + static_cast<int>(i) + 1;
+            switch (trace_line.event_type) {
+                case TraceEventType::ACQUIRE:
+                    events.push_back(Event{EventType::ACQUIRE, trace_line.thread_id, position, trace_line.target});
+                    break;
+                case TraceEventType::RELEASE:
+                    events.push_back(Event{EventType::RELEASE, trace_line.thread_id, position, trace_line.target});
+                    break;
+                case TraceEventType::READ:
+                    events.push_back(Event{EventType::READ, trace_line.thread_id, position, trace_line.target});
+                    break;
+                case TraceEventType::WRITE:
+                    events.push_back(Event{EventType::WRITE, trace_line.thread_id, position, trace_line.target});
+                    break;
+                case TraceEventType::FORK:
+                    if (speedygo_format) {
+                        signal_list[trace_line.target] = trace_line.thread_id;
+                    } else {
+                        events.push_back(Event{EventType::FORK, trace_line.thread_id, position, trace_line.target});
+                    }
+                    break;
+                case TraceEventType::JOIN:
+                    if (speedygo_format) {
+                        auto thread_to_fork_from = signal_list.find(trace_line.target);
+                        if (thread_to_fork_from != signal_list.end()) {
+                            events.push_back(Event{EventType::FORK, thread_to_fork_from->second, position, trace_line.thread_id});
+                        }
+                    } else {
+                        events.push_back(Event{EventType::JOIN, trace_line.thread_id, position, trace_line.target});
+                    }
+                    break;
+                case TraceEventType::NOTIFY:
+                    events.push_back(Event{EventType::NOTIFY, trace_line.thread_id, position, trace_line.target});
+                    break;
+                case TraceEventType::NOTIFY_WAIT:
+                    events.push_back(Event{EventType::WAIT, trace_line.thread_id, position, trace_line.target});
+                    break;
+                case TraceEventType::ATOMIC:
+                    // TODO: implement Atomic events
+                    break;
+            }
+        }
+        return events;
     }
 
-    auto event_len = current_result->at(1).find('(');
-    auto event_type = std_event_map.find(current_result->at(1).substr(0, event_len));
-    if (event_type != std_event_map.end()) {
-        result.event_type = event_type->second;
-        auto target = current_result->at(1).substr(event_len + 1, current_result->at(1).length() - event_len - 2);
-
-        if (result.event_type == "SIG" || result.event_type == "WT") {
-            auto current_std_target_thread = std_thread_map.find(target);
-            if (current_std_target_thread == std_thread_map.end()) {
-                std_thread_map[target] = std_thread_counter;
-                result.target = std_thread_counter;
-                std_thread_counter += 1;
-            } else {
-                result.target = current_std_target_thread->second;
-            }
-        } else {
-            auto current_std_lock_id = std_lock_id_map.find(target);
-            if (current_std_lock_id == std_lock_id_map.end()) {
-                std_lock_id_map[target] = std_lock_id_counter;
-                result.target = std_lock_id_counter;
-                std_lock_id_counter += 1;
-            } else {
-                result.target = current_std_lock_id->second;
+private:
+    bool speedygo_format;
+    // SpeedyGo signal id -> signalling thread
+    std::unordered_map<int, int> signal_list = {};
+    std::vector<Event> events = {};
+};
+
+// Hands a batch of lines, starting after line_index, to every run.
+void dispatch_batch(std::vector<DetectorRun> *runs, EventDecoder *decoder, const TraceLine *batch, size_t count, int line_index, bool verboseMode) {
+    const std::vector<Event> &events = decoder->decode(batch, count, line_index);
+    for (auto &run: *runs) {
+        auto start_time = std::chrono::steady_clock::now();
+        run.lockFrame->process_batch(events.data(), events.size());
+        run.event_time += std::chrono::steady_clock::now() - start_time;
+    }
+
+    // occasional reporting on progress - report to stdout every million lines
+    for (int line = (line_index / 1000000 + 1) * 1000000; verboseMode && line <= line_index + static_cast<int>(count); line += 1000000) {
+        std::cout << "Parsed line " << line << std::endl;
+    }
+}
+
+/**
+ * Passes all events of parser (TraceParser or BinaryTraceParser) to every run.
+ * Events are decoded once per batch, then each run handles the whole batch, which keeps the timing per run cheap.
+ * Returns the number of lines, or -1 after reporting a malformed line.
+ */
+template<typename Parser>
+int feed_events(Parser *parser, std::vector<DetectorRun> *runs, bool speedygo_format, bool verboseMode) {
+    const size_t EVENTS_PER_BATCH = 1 << 16;
+    std::vector<TraceLine> batch = {};
+    batch.reserve(EVENTS_PER_BATCH);
+    EventDecoder decoder(speedygo_format);
+    TraceLine trace_line;
+    int line_index = 0;
+
+    // read out the mapped file batch by batch
+    bool has_more_lines = true;
+    while (has_more_lines) {
+        batch.clear();
+        // Any malformed line throws and exits the program.
+        try {
+            while (batch.size() < EVENTS_PER_BATCH && (has_more_lines = parser->next(&trace_line))) {
+                batch.push_back(trace_line);
             }
         }
+        catch (...) {
+            std::cout << "Bad file format on line " << line_index + batch.size() + 1 << ": " << parser->current_line() << std::endl;
+            return -1;
+        }
+
+        dispatch_batch(runs, &decoder, batch.data(), batch.size(), line_index, verboseMode);
+        line_index += static_cast<int>(batch.size());
     }
 
-    return result;
+    return line_index;
+}
+
+/**
+ * Same as feed_events, but the parser runs on its own thread and hands the events over through an SpscQueue,
+ * so parsing overlaps with the detectors. Reports how full the queue was to show which side is the bottleneck.
+ */
+template<typename Parser>
+int feed_events_pipelined(Parser *parser, std::vector<DetectorRun> *runs, bool speedygo_format, bool verboseMode) {
+    const size_t QUEUE_CAPACITY = 1 << 16;
+    const size_t EVENTS_PER_BATCH = 1 << 12;
+    SpscQueue<TraceLine> queue(QUEUE_CAPACITY);
+
+    // Set by the parser thread before it closes the queue.
+    int bad_line_index = 0;
+    std::string bad_line;
+    std::thread parser_thread([&]() {
+        TraceLine trace_line;
+        int parsed_lines = 0;
+        try {
+            while (parser->next(&trace_line)) {
+                queue.push(trace_line);
+                parsed_lines++;
+            }
+        }
+        catch (...) {
+            bad_line_index = parsed_lines + 1;
+            bad_line = std::string(parser->current_line());
+        }
+        queue.close();
+    });
+
+    EventDecoder decoder(speedygo_format);
+    std::vector<TraceLine> batch(EVENTS_PER_BATCH);
+    int line_index = 0;
+    size_t count;
+    while ((count = queue.pop(batch.data(), batch.size())) > 0) {
+        dispatch_batch(runs, &decoder, batch.data(), count, line_index, verboseMode);
+        line_index += static_cast<int>(count);
+    }
+    parser_thread.join();
+
+    auto statistics = queue.statistics();
+    double average_occupancy = statistics.pops == 0 ? 0 : static_cast<double>(statistics.occupancy_sum) / statistics.pops;
+    std::cout << "Pipeline queue: " << std::fixed << std::setprecision(1) << 100 * average_occupancy / statistics.capacity
+              << "% average occupancy of " << statistics.capacity << " events, parser waited " << statistics.full_waits
+              << " times on a full queue, detectors waited " << statistics.empty_waits << " times on an empty queue."
+              << std::defaultfloat << std::endl;
+
+    if (bad_line_index != 0) {
+        std::cout << "Bad file format on line " << bad_line_index << ": " << bad_line << std::endl;
+        return -1;
+    }
+    return line_index;
 }
 
 std::string stringifyStringVector(const std::vector<std::string> &v) {
@@ -117,7 +258,8 @@ std::string stringifyStringVector(const std::vector<std::string> &v) {
 
 int main(int argc, char *argv[]) {
 
-    const std::string usageString = "Usage: ./reader -d [PWR|UNDEAD|PWRUNDEAD] [--speedygo] /path/to/file\n";
+    const std::string usageString = "Usage: ./reader -d [PWR|UNDEAD|PWRUNDEAD] [--speedygo] [--history-size N] [--vc-limit N] [--single-pass] [--pipeline] [--aggregate resource|threads|resource-threads|cycles] [--threads N] [--online] [--max-chain-length N] [--max-states N] [--time-limit MS] [--unique-cycles] /path/to/file\n"
+                                    "       ./reader --convert /path/to/output [--std|--speedygo] /path/to/file\n";
 
     if ((argc < 2)) {
         std::cout << "Not enough arguments specified." << usageString;
@@ -137,6 +279,24 @@ int main(int argc, char *argv[]) {
             {"--timestamp",  6},
             {"-d",           7},
             {"--detector",   7},
+            {"--history-size", 8},
+            {"--vc-limit",   9},
+            {"--convert",    10},
+            {"--single-pass", 11},
+            {"--pipeline",   12},
+            {"--aggregate",  13},
+            {"--threads",    14},
+            {"--online",     15},
+            {"--max-chain-length", 16},
+            {"--max-states", 17},
+            {"--time-limit", 18},
+            {"--unique-cycles", 19},
+    };
+    std::map<std::string, RaceAggregationKey> aggregationKeys = {
+            {"resource",         RaceAggregationKey::RESOURCE},
+            {"threads",          RaceAggregationKey::THREAD_PAIR},
+            {"resource-threads", RaceAggregationKey::RESOURCE_AND_THREAD_PAIR},
+            {"cycles",           RaceAggregationKey::LOCK_CYCLE},
     };
 
     std::vector<std::string> enabledDetectors = {};
@@ -147,6 +307,12 @@ int main(int argc, char *argv[]) {
     bool hideResultsFromStdout = false;
     bool csvOutput = false;
     bool addTimestampToOutput = false;
+    DetectorConfig detectorConfig = {};
+    std::filesystem::path convertPath;
+    bool singlePass = false;
+    bool pipeline = false;
+    bool aggregate = false;
+    RaceAggregationKey aggregationKey = RaceAggregationKey::RESOURCE_AND_THREAD_PAIR;
     std::filesystem::path baseOutputPath("./");
     std::filesystem::path tracePath;
 
@@ -195,6 +361,83 @@ int main(int argc, char *argv[]) {
                     }
                     i++; // skip the next argument, assuming it was set as a detector.
                     break;
+                case 8: // --history-size Number of history entries kept per lock and thread, 0 disables the history.
+                case 9: // --vc-limit Number of vector clocks kept per lock dependency.
+                {
+                    bool isHistorySize = foundFlag->second == 8;
+                    if (i + 1 >= argc || !std::isdigit(argv[i + 1][0]) || (!isHistorySize && std::stoul(argv[i + 1]) == 0)) {
+                        std::cout << "An invalid value for " << argv[i] << " was specified." << std::endl;
+                        exit(1);
+                    }
+                    if (isHistorySize) {
+                        detectorConfig.history_size = std::stoul(argv[i + 1]);
+                    } else {
+                        detectorConfig.vector_clocks_per_dependency = std::stoul(argv[i + 1]);
+                    }
+                    i++; // skip the value
+                    break;
+                }
+                case 10: // --convert Writes the trace as binary trace to the given path instead of analyzing it.
+                    if (i + 1 >= argc) {
+                        std::cout << "No output path for " << argv[i] << " was specified." << std::endl;
+                        exit(1);
+                    }
+                    convertPath = std::filesystem::path(argv[i + 1]);
+                    i++; // skip the output path
+                    break;
+                case 11: // --single-pass Parses the trace once and feeds every event to all detectors.
+                    singlePass = true;
+                    break;
+                case 12: // --pipeline Parses on a separate thread while the detectors handle the events.
+                    pipeline = true;
+                    break;
+                case 13: // --aggregate Reports every distinct race once, with its last position and count.
+                {
+                    auto foundKey = i + 1 < argc ? aggregationKeys.find(argv[i + 1]) : aggregationKeys.end();
+                    if (foundKey == aggregationKeys.end()) {
+                        std::cout << "An invalid value for " << argv[i] << " was specified." << std::endl;
+                        exit(1);
+                    }
+                    aggregate = true;
+                    aggregationKey = foundKey->second;
+                    // The deadlock detectors only tell the cycles apart when asked to
+                    detectorConfig.identify_cycles = aggregationKey == RaceAggregationKey::LOCK_CYCLE;
+                    i++; // skip the key
+                    break;
+                }
+                case 14: // --threads Number of threads searching for deadlock cycles after the trace was read.
+                    if (i + 1 >= argc || !std::isdigit(argv[i + 1][0]) || std::stoul(argv[i + 1]) == 0) {
+                        std::cout << "An invalid value for " << argv[i] << " was specified." << std::endl;
+                        exit(1);
+                    }
+                    detectorConfig.worker_threads = std::stoul(argv[i + 1]);
+                    i++; // skip the value
+                    break;
+                case 15: // --online UNDEAD searches the deadlock cycles of every new lock dependency while reading.
+                    detectorConfig.online_deadlock_detection = true;
+                    break;
+                case 16: // --max-chain-length Dependencies of the longest deadlock cycle searched for, 0 is unlimited.
+                case 17: // --max-states Chain extensions the deadlock search may try, 0 is unlimited.
+                case 18: // --time-limit Milliseconds the deadlock search may take, 0 is unlimited.
+                {
+                    if (i + 1 >= argc || !std::isdigit(argv[i + 1][0])) {
+                        std::cout << "An invalid value for " << argv[i] << " was specified." << std::endl;
+                        exit(1);
+                    }
+                    size_t limit = std::stoul(argv[i + 1]);
+                    if (foundFlag->second == 16) {
+                        detectorConfig.max_chain_length = limit;
+                    } else if (foundFlag->second == 17) {
+                        detectorConfig.max_search_states = limit;
+                    } else {
+                        detectorConfig.max_search_milliseconds = limit;
+                    }
+                    i++; // skip the value
+                    break;
+                }
+                case 19: // --unique-cycles Reports every deadlock cycle once instead of once per chain closing it.
+                    detectorConfig.unique_cycles = true;
+                    break;
 
             }
         } else { // not a flag: assume trace file.
@@ -212,6 +455,14 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    // The online search runs once per new dependency and can't stop and resume, only the chain length bounds it.
+    if (detectorConfig.online_deadlock_detection &&
+        (detectorConfig.max_search_states != 0 || detectorConfig.max_search_milliseconds != 0)) {
+        std::cout << "--online can't be combined with --max-states or --time-limit, use --max-chain-length instead. "
+                  << usageString;
+        return 1;
+    }
+
     // If an output emitting a file is enabled, check if the output directory is writable.
     if (outputToFile) {
         if (!std::filesystem::is_directory(baseOutputPath)) {
@@ -226,6 +477,38 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    // Conversion only needs the trace, no detectors or outputs.
+    if (!convertPath.empty()) {
+        if (tracePath.empty()) {
+            std::cout << "No trace file was specified. " << usageString;
+            return 1;
+        }
+        MappedFile file(tracePath);
+        if (!file.good()) {
+            std::cout << "The specified trace file " << tracePath << " cannot be found." << std::endl;
+            return 1;
+        }
+        if (is_binary_trace(file.begin(), file.end())) {
+            std::cout << "The specified trace file " << tracePath << " already is a binary trace." << std::endl;
+            return 1;
+        }
+
+        TraceParser parser(file.begin(), file.end(), std_format);
+        try {
+            uint64_t event_count = convert_to_binary_trace(&parser, speedygo_format, convertPath);
+            std::cout << "Converted " << event_count << " events to " << convertPath << std::endl;
+        }
+        catch (const std::invalid_argument &) {
+            std::cout << "Bad file format: " << parser.current_line() << std::endl;
+            return 1;
+        }
+        catch (const std::runtime_error &error) {
+            std::cout << error.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
     // If no detector was found, exit the program.
     if (enabledDetectors.empty()) {
         std::cout << "No valid detectors were specified. " << usageString;
@@ -242,179 +525,117 @@ int main(int argc, char *argv[]) {
               << "Enabled detectors: " << stringifyStringVector(enabledDetectors) << std::endl
               << "Verbose: " << verboseMode << " CSV: " << csvOutput << std::endl;
 
-    // Main program loop. Iterate over each supplied detector.
-    for (auto &detectorName: enabledDetectors) {
-        // attempt to get a file stream from the provided *last* argument (argc - 1). If the file is not good (any error flags), exit program
-        std::ifstream file(tracePath);
+    // Parses the trace once and feeds every event to all runs. Returns the number of lines or -1 on errors.
+    auto feed_trace = [&](std::vector<DetectorRun> *runs) -> int {
+        // map the whole trace file into memory, the parser scans it in place. If that fails, exit program
+        MappedFile file(tracePath);
         if (!file.good()) {
             std::cout << "The specified trace file " << tracePath << " cannot be found." << std::endl;
-            return 1;
+            return -1;
         }
-        std::cout << "Beginning analysis using " << detectorName << std::endl;
-        // create a new lockframe instance with the passed detector argument, and store a start_tim
-        LockFrame *lockFrame = create_lockframe_with_detector(detectorName);
-        auto start_time = std::chrono::steady_clock::now();
 
-        // instantiate line as where the program will store the currently processed line
-        std::string line;
-        int line_index = 0;
-        // If the file is in std_format, the separator is a pipe. Otherwise assume commas.
-        const char separator = std_format ? '|' : ',';
-
-        // read out the passed file line for line
-        while (std::getline(file, line)) {
-            line_index++;
-            std::stringstream ss(line);
-            std::array<std::string, 3> result{"", "", ""};
-
-            // As long as the string is good, process the first three entries on the line. (There should always be three entries)
-            // This sets the previously instantiated result at position i to the result at that position.
-            int good_count = 0;
-            while (ss.good() && good_count < 3) {
-                std::string substring;
-                getline(ss, substring, separator);
-                result[good_count] = substring;
-                good_count += 1;
-            }
-
-            // If the last element in the results array is still blank, then the file must've been malformed. Exit.
-            if (result[2].empty()) {
-                std::cout << "Bad file format on line " << line_index << ": " << line << std::endl;
-                return 1;
+        try {
+            if (is_binary_trace(file.begin(), file.end())) {
+                BinaryTraceParser parser(file.begin(), file.end());
+                bool binary_speedygo_format = speedygo_format || (parser.header().flags & BINARY_TRACE_FLAG_SPEEDYGO) != 0;
+                return pipeline ? feed_events_pipelined(&parser, runs, binary_speedygo_format, verboseMode)
+                                : feed_events(&parser, runs, binary_speedygo_format, verboseMode);
             }
+            TraceParser parser(file.begin(), file.end(), std_format);
+            return pipeline ? feed_events_pipelined(&parser, runs, speedygo_format, verboseMode)
+                            : feed_events(&parser, runs, speedygo_format, verboseMode);
+        }
+        catch (const std::invalid_argument &error) {
+            std::cout << "Bad binary trace " << tracePath << ": " << error.what() << std::endl;
+            return -1;
+        }
+    };
 
-            // Attempt to convert the split line into the internal representation.. Any thrown errors will exit the program.
-            try {
-                TraceLine trace_line;
-                if (std_format) {
-                    // If we have the std-format set, we convert it in-place.
-                    trace_line = convert_result_from_std(&result);
-                } else {
-                    // Otherwise, we construct a simple tuple that converts the string numbers to integers.
-                    trace_line = {std::stoi(result[0]), result[1], std::stoi(result[2])};
-                }
+    // Name of an output file of a detector, e.g. ./PWR_trace.log.txt or ./PWR_STATS_trace.log.txt
+    auto output_file_path = [&](const std::string &detectorName, const std::string &infix) {
+        std::stringstream fileName;
+        fileName << "/" << detectorName << "_" << infix << tracePath.filename().string();
+        if (addTimestampToOutput) {
+            fileName << "_";
+            auto t = std::time(nullptr);
+            auto tm = *std::localtime(&t);
+            fileName << std::put_time(&tm, "%d-%m-%Y_%H-%M-%S");
+        }
+        if (csvOutput)
+            fileName << ".csv";
+        else
+            fileName << ".txt";
+        return baseOutputPath.string() + fileName.str();
+    };
 
-                // Pass the found events to the lockframe detector through function calls.
-                if (trace_line.event_type == "LK") {
-                    lockFrame->acquire_event(trace_line.thread_id, line_index, trace_line.target);
-                } else if (trace_line.event_type == "UK") {
-                    lockFrame->release_event(trace_line.thread_id, line_index, trace_line.target);
-                } else if (trace_line.event_type == "RD") {
-                    lockFrame->read_event(trace_line.thread_id, line_index, trace_line.target);
-                } else if (trace_line.event_type == "WR") {
-                    lockFrame->write_event(trace_line.thread_id, line_index, trace_line.target);
-                } else if (trace_line.event_type == "SIG") {
-                    if (speedygo_format) {
-                        signal_list[trace_line.target] = trace_line.thread_id;
-                    } else {
-                        lockFrame->fork_event(trace_line.thread_id, line_index, trace_line.target);
-                    }
-                } else if (trace_line.event_type == "WT") {
-                    if (speedygo_format) {
-                        auto thread_to_fork_from = signal_list.find(trace_line.target);
-                        if (thread_to_fork_from != signal_list.end()) {
-                            lockFrame->fork_event(thread_to_fork_from->second, line_index, trace_line.thread_id);
-                        }
-                    } else {
-                        lockFrame->join_event(trace_line.thread_id, line_index, trace_line.target);
-                    }
-                } else if (trace_line.event_type == "NT") {
-                    lockFrame->notify_event(trace_line.thread_id, line_index, trace_line.target);
-                } else if (trace_line.event_type == "NTWT") {
-                    lockFrame->wait_event(trace_line.thread_id, line_index, trace_line.target);
-                } else if (trace_line.event_type == "AWR" || trace_line.event_type == "ARD") {
-                    // TODO: implement Atomic events
-                    // std::cout << "Atomic not implemented " << line_index <<  ": " << line << std::endl;
-                } else { // no valid event type found, assume bad file format.
-                    throw std::runtime_error(
-                            std::string("Trace file contains invalid event type: " + trace_line.event_type));
-                }
+    // Creates the lockframe of a detector with its race outputs as specified by the user.
+    auto create_run = [&](const std::string &detectorName) {
+        DetectorRun run{detectorName, create_lockframe_with_detector(detectorName, detectorConfig)};
+        if (aggregate) {
+            // only the distinct races are written out, once the run is reported
+            auto aggregator = std::make_unique<RaceAggregator>(aggregationKey);
+            run.aggregator = aggregator.get();
+            run.race_sinks.push_back(std::move(aggregator));
+        } else {
+            if (outputToFile) {
+                run.race_sinks.push_back(std::make_unique<FileRaceSink>(output_file_path(detectorName, ""), csvOutput));
             }
-            catch (...) { // failing to parse should crash the whole thing.
-                std::cout << "Bad file format on line " << line_index << ": " << line << std::endl;
-                return 1;
-            }
-
-            // occasional reporting on progress - report to stdout every million lines
-            if (verboseMode && line_index % 1000000 == 0) {
-                std::cout << "Parsed line " << line_index << std::endl;
+            if (!hideResultsFromStdout && singlePass) {
+                auto deferred_races = std::make_unique<VectorRaceSink>();
+                run.deferred_races = deferred_races.get();
+                run.race_sinks.push_back(std::move(deferred_races));
+            } else if (!hideResultsFromStdout) {
+                run.race_sinks.push_back(std::make_unique<StreamRaceSink>(&std::cout, csvOutput));
             }
         }
+        for (auto &sink: run.race_sinks) {
+            run.lockFrame->add_race_sink(sink.get());
+        }
+        return run;
+    };
 
-        // set the parse time finish.
-        auto end_time = std::chrono::steady_clock::now();
-        std::cout << "File parsing for the detector " << detectorName << " has finished. Analysis commences now."
+    // Lets the detector of a fed run conclude and reports its races (and its statistics) as specified by the user.
+    auto report_results = [&](DetectorRun &run, int line_index, std::chrono::steady_clock::duration duration) {
+        std::cout << "File parsing for the detector " << run.name << " has finished. Analysis commences now."
                   << std::endl;
 
-        // Perform the actual race calculation on the lockFrame implementation / detector and store them in races
-        std::vector<DataRace> races = lockFrame->get_races();
-        std::cout << detectorName << " has concluded analysis." << std::endl;
+        // Perform the actual race calculation on the lockFrame implementation / detector, the sinks receive the races
+        run.lockFrame->get_races();
+        std::cout << run.name << " has concluded analysis." << std::endl;
 
         // hint message about output not getting dumped into console.
         if (hideResultsFromStdout) {
             std::cout << "Results will only be written to the specified output directory." << std::endl;
         }
 
-        std::ofstream raceOutput;
-        if (outputToFile) {
-            std::stringstream fileName;
-            fileName << "/" << detectorName << "_" << tracePath.filename().string();
-            if (addTimestampToOutput) {
-                fileName << "_";
-                auto t = std::time(nullptr);
-                auto tm = *std::localtime(&t);
-                fileName << std::put_time(&tm, "%d-%m-%Y_%H-%M-%S");
+        if (run.deferred_races != nullptr) {
+            for (auto &race: run.deferred_races->races) {
+                write_race(std::cout, race, csvOutput);
             }
-            if (csvOutput)
-                fileName << ".csv";
-            else
-                fileName << ".txt";
-
-            std::filesystem::path racePath(baseOutputPath.string() + fileName.str());
-            raceOutput.open(racePath);
+            std::cout.flush();
         }
-        // Report all races as specified by the user
-        for (auto &race: races) {
-            std::stringstream raceStream;
-            if (csvOutput) {
-                // CSV-compatible output format. Reports as THREAD1, THREAD2, RESOURCENAME, TRACELINE
-                raceStream << race.thread_id_1 << "," << race.thread_id_2 << "," << race.resource_name << ","
-                           << race.trace_position << std::endl;
-            } else {
-                // original format established by Jan Metzger.
-                raceStream << "T" << race.thread_id_1 << " <--> T" << race.thread_id_2 << ", Resource: ["
-                           << race.resource_name << "], Line: " << race.trace_position << std::endl;
+
+        if (run.aggregator != nullptr) {
+            std::ofstream raceOutput;
+            if (outputToFile) {
+                raceOutput.open(output_file_path(run.name, ""));
+            }
+            for (auto &race: run.aggregator->races()) {
+                if (!hideResultsFromStdout)
+                    write_aggregated_race(std::cout, race, csvOutput);
+                if (outputToFile)
+                    write_aggregated_race(raceOutput, race, csvOutput);
             }
-            // Write results to outputs
-            if (!hideResultsFromStdout)
-                std::cout << raceStream.str();
-            if (outputToFile)
-                raceOutput << raceStream.str();
+            std::cout.flush();
         }
-        if (outputToFile)
-            raceOutput.close(); // close output file if it was necessary.
 
 #ifdef COLLECT_STATISTICS
         // Report statistics, if defined during compile time.
         std::ofstream statOutput;
         if (outputToFile) {
-            std::stringstream fileName;
-            fileName << "/" << detectorName << "_STATS_" << tracePath.filename().string();
-            if (addTimestampToOutput) {
-                fileName << "_";
-                auto t = std::time(nullptr);
-                auto tm = *std::localtime(&t);
-                fileName << std::put_time(&tm, "%d-%m-%Y_%H-%M-%S");
-            }
-            if (csvOutput)
-                fileName << ".csv";
-            else
-                fileName << ".txt";
-
-            std::filesystem::path statPath(baseOutputPath.string() + fileName.str());
-            statOutput.open(statPath);
+            statOutput.open(output_file_path(run.name, "STATS_"));
         }
-        for (auto &stat: lockFrame->statistics) {
+        for (auto &stat: run.lockFrame->statistics) {
             std::stringstream statStream;
             if (csvOutput) {
                 statStream << stat.statistics_key << "," << stat.statistics_value << std::endl;
@@ -437,9 +658,60 @@ int main(int argc, char *argv[]) {
 #endif // COLLECT_STATISTICS
 
         std::cout << "Parsed " << line_index << " lines in "
-                  << std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count() << "ms."
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(duration).count() << "ms."
                   << std::endl;
-        std::cout << "Found " << races.size() << " races." << std::endl;
+        std::cout << "Found " << run.lockFrame->race_count << " races." << std::endl;
+        if (!run.lockFrame->detector->is_complete()) {
+            std::cout << "The result is truncated, the deadlock search hit its limits." << std::endl;
+        } else {
+            std::cout << "The result is complete." << std::endl;
+        }
+        if (run.aggregator != nullptr) {
+            std::cout << "Aggregated into " << run.aggregator->races().size() << " distinct races." << std::endl;
+        }
+    };
+
+    if (singlePass) {
+        std::vector<DetectorRun> runs = {};
+        for (auto &detectorName: enabledDetectors) {
+            runs.push_back(create_run(detectorName));
+        }
+        std::cout << "Beginning analysis using " << stringifyStringVector(enabledDetectors) << "in a single pass" << std::endl;
+        auto start_time = std::chrono::steady_clock::now();
+        int line_index = feed_trace(&runs);
+        if (line_index < 0) {
+            return 1;
+        }
+        auto parse_time = std::chrono::steady_clock::now() - start_time;
+        for (auto &run: runs) {
+            parse_time -= run.event_time;
+        }
+        std::cout << "Parsing the trace once took "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(parse_time).count() << "ms." << std::endl;
+
+        // The time reported per detector is the time spent in its event handlers.
+        for (auto &run: runs) {
+            report_results(run, line_index, run.event_time);
+        }
+        return 0;
+    }
+
+    // Main program loop. Iterate over each supplied detector.
+    for (auto &detectorName: enabledDetectors) {
+        std::cout << "Beginning analysis using " << detectorName << std::endl;
+        // create a new lockframe instance with the passed detector argument, and store a start_tim
+        std::vector<DetectorRun> runs = {};
+        runs.push_back(create_run(detectorName));
+        auto start_time = std::chrono::steady_clock::now();
+
+        int line_index = feed_trace(&runs);
+        if (line_index < 0) {
+            return 1;
+        }
+
+        // set the parse time finish.
+        auto end_time = std::chrono::steady_clock::now();
+        report_results(runs[0], line_index, end_time - start_time);
     }
 
     return 0;
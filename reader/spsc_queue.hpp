@@ -0,0 +1,128 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+/**
+ * Bounded lock-free ring between exactly one producer and one consumer thread.
+ * The producer publishes its writes every PUBLISH_BATCH elements (and on flush/close), the consumer takes everything
+ * published at once, so the shared indices are touched once per batch instead of once per element.
+ * Both sides spin (yielding) while the ring is full or empty and count how often they had to, together with the
+ * occupancy the consumer saw, this tells which side is the bottleneck.
+ */
+template<typename T>
+class SpscQueue {
+public:
+    struct Statistics {
+        // Times the producer found the ring full, i.e. waited for the consumer.
+        size_t full_waits = 0;
+        // Times the consumer found the ring empty, i.e. waited for the producer.
+        size_t empty_waits = 0;
+        // Elements available per successful pop, summed up, and the number of pops.
+        size_t occupancy_sum = 0;
+        size_t pops = 0;
+        size_t capacity = 0;
+    };
+
+    // capacity is rounded up to a power of two.
+    explicit SpscQueue(size_t capacity) {
+        size_t rounded_capacity = 1;
+        while (rounded_capacity < capacity) {
+            rounded_capacity <<= 1;
+        }
+        slots.resize(rounded_capacity);
+        mask = rounded_capacity - 1;
+    }
+
+    // Producer side
+    void push(const T &value) {
+        if (local_head - cached_tail > mask) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            while (local_head - cached_tail > mask) {
+                publish();
+                producer_full_waits++;
+                std::this_thread::yield();
+                cached_tail = tail.load(std::memory_order_acquire);
+            }
+        }
+        slots[local_head & mask] = value;
+        local_head++;
+        if (local_head - published_head >= PUBLISH_BATCH) {
+            publish();
+        }
+    }
+
+    // Producer side, no more elements will follow.
+    void close() {
+        publish();
+        closed.store(true, std::memory_order_release);
+    }
+
+    /**
+     * Consumer side: copies up to max_count elements to out, waits while the ring is empty.
+     * Returns 0 once the producer closed the ring and everything was consumed.
+     */
+    size_t pop(T *out, size_t max_count) {
+        size_t available;
+        while ((available = head.load(std::memory_order_acquire) - local_tail) == 0) {
+            if (closed.load(std::memory_order_acquire)) {
+                // close() publishes before it sets closed, one more look at head sees the last elements.
+                available = head.load(std::memory_order_acquire) - local_tail;
+                if (available == 0) {
+                    return 0;
+                }
+                break;
+            }
+            consumer_empty_waits++;
+            std::this_thread::yield();
+        }
+
+        occupancy_sum += available;
+        pops++;
+        size_t count = available < max_count ? available : max_count;
+        for (size_t i = 0; i < count; i++) {
+            out[i] = slots[(local_tail + i) & mask];
+        }
+        local_tail += count;
+        tail.store(local_tail, std::memory_order_release);
+        return count;
+    }
+
+    // Only valid after both threads are done.
+    Statistics statistics() const {
+        return Statistics{producer_full_waits, consumer_empty_waits, occupancy_sum, pops, slots.size()};
+    }
+
+private:
+    static const size_t PUBLISH_BATCH = 256;
+
+    std::vector<T> slots = {};
+    size_t mask = 0;
+
+    // Written by the producer, read by the consumer, each on its own cache line.
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+    alignas(64) std::atomic<bool> closed{false};
+
+    // Producer only
+    alignas(64) size_t local_head = 0;
+    size_t published_head = 0;
+    size_t cached_tail = 0;
+    size_t producer_full_waits = 0;
+
+    // Consumer only
+    alignas(64) size_t local_tail = 0;
+    size_t consumer_empty_waits = 0;
+    size_t occupancy_sum = 0;
+    size_t pops = 0;
+
+    void publish() {
+        published_head = local_head;
+        head.store(local_head, std::memory_order_release);
+    }
+};
+
+#endif
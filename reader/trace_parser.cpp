@@ -0,0 +1,175 @@
+#include "trace_parser.hpp"
+
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::filesystem::path &path) {
+    int file_descriptor = open(path.c_str(), O_RDONLY);
+    if (file_descriptor < 0) {
+        return;
+    }
+
+    struct stat file_stat = {};
+    if (fstat(file_descriptor, &file_stat) == 0 && S_ISREG(file_stat.st_mode)) {
+        size = static_cast<size_t>(file_stat.st_size);
+        if (size == 0) {
+            // mmap refuses empty mappings, an empty trace is still a valid one.
+            is_good = true;
+        } else {
+            void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+            if (mapping != MAP_FAILED) {
+                madvise(mapping, size, MADV_SEQUENTIAL);
+                data = static_cast<const char *>(mapping);
+                is_good = true;
+            }
+        }
+    }
+    close(file_descriptor);
+}
+
+MappedFile::~MappedFile() {
+    if (data != nullptr) {
+        munmap(const_cast<char *>(data), size);
+    }
+}
+
+// Packs an event code of up to four characters into an int, so codes can be matched with a switch.
+static constexpr unsigned event_code(std::string_view code) {
+    unsigned value = 0;
+    for (char character: code) {
+        value = value << 8 | static_cast<unsigned char>(character);
+    }
+    return value;
+}
+
+// Same leniency as std::stoi: leading whitespace and a sign are accepted, anything after the digits is ignored.
+static int parse_int(std::string_view field) {
+    size_t i = 0;
+    while (i < field.size() && (field[i] == ' ' || field[i] == '\t')) {
+        i++;
+    }
+    bool negative = i < field.size() && field[i] == '-';
+    if (i < field.size() && (field[i] == '-' || field[i] == '+')) {
+        i++;
+    }
+    if (i == field.size() || field[i] < '0' || field[i] > '9') {
+        throw std::invalid_argument("Not a number");
+    }
+
+    long long value = 0;
+    for (; i < field.size() && field[i] >= '0' && field[i] <= '9'; i++) {
+        value = value * 10 + (field[i] - '0');
+        if (value > static_cast<long long>(INT_MAX) + 1) {
+            throw std::invalid_argument("Number out of range");
+        }
+    }
+    value = negative ? -value : value;
+    if (value > INT_MAX) {
+        throw std::invalid_argument("Number out of range");
+    }
+    return static_cast<int>(value);
+}
+
+TraceParser::TraceParser(const char *begin, const char *end, bool std_format)
+        : position(begin), end(end), std_format(std_format) {}
+
+bool TraceParser::next(TraceLine *trace_line) {
+    if (position == nullptr || position >= end) {
+        return false;
+    }
+
+    auto line_end = static_cast<const char *>(memchr(position, '\n', end - position));
+    if (line_end == nullptr) {
+        line_end = end;
+    }
+    line = std::string_view(position, line_end - position);
+    position = line_end < end ? line_end + 1 : end;
+
+    // Only the first three fields are used, the third one ends at the next separator.
+    const char separator = std_format ? '|' : ',';
+    std::string_view fields[3] = {};
+    size_t field_start = 0;
+    for (int field = 0; field < 3; field++) {
+        if (field_start > line.size()) {
+            break;
+        }
+        size_t field_end = line.find(separator, field_start);
+        if (field_end == std::string_view::npos) {
+            field_end = line.size();
+        }
+        fields[field] = line.substr(field_start, field_end - field_start);
+        field_start = field_end + 1;
+    }
+    if (fields[2].empty()) {
+        throw std::invalid_argument("Missing field");
+    }
+
+    if (std_format) {
+        parse_std(trace_line, fields);
+    } else {
+        parse_csv(trace_line, fields);
+    }
+    return true;
+}
+
+void TraceParser::parse_csv(TraceLine *trace_line, std::string_view fields[3]) {
+    trace_line->thread_id = parse_int(fields[0]);
+    trace_line->target = parse_int(fields[2]);
+
+    if (fields[1].size() > 4) {
+        throw std::invalid_argument("Invalid event type");
+    }
+    switch (event_code(fields[1])) {
+        case event_code("RD"): trace_line->event_type = TraceEventType::READ; break;
+        case event_code("WR"): trace_line->event_type = TraceEventType::WRITE; break;
+        case event_code("LK"): trace_line->event_type = TraceEventType::ACQUIRE; break;
+        case event_code("UK"): trace_line->event_type = TraceEventType::RELEASE; break;
+        case event_code("SIG"): trace_line->event_type = TraceEventType::FORK; break;
+        case event_code("WT"): trace_line->event_type = TraceEventType::JOIN; break;
+        case event_code("NT"): trace_line->event_type = TraceEventType::NOTIFY; break;
+        case event_code("NTWT"): trace_line->event_type = TraceEventType::NOTIFY_WAIT; break;
+        case event_code("AWR"):
+        case event_code("ARD"): trace_line->event_type = TraceEventType::ATOMIC; break;
+        default:
+            throw std::invalid_argument("Invalid event type");
+    }
+}
+
+// Events look like acq(L1), the target is whatever is inside the parentheses.
+void TraceParser::parse_std(TraceLine *trace_line, std::string_view fields[3]) {
+    size_t event_len = fields[1].find('(');
+    if (event_len == std::string_view::npos || event_len > 4 || fields[1].size() < event_len + 2) {
+        throw std::invalid_argument("Invalid event type");
+    }
+    switch (event_code(fields[1].substr(0, event_len))) {
+        case event_code("r"): trace_line->event_type = TraceEventType::READ; break;
+        case event_code("w"): trace_line->event_type = TraceEventType::WRITE; break;
+        case event_code("acq"): trace_line->event_type = TraceEventType::ACQUIRE; break;
+        case event_code("rel"): trace_line->event_type = TraceEventType::RELEASE; break;
+        case event_code("fork"): trace_line->event_type = TraceEventType::FORK; break;
+        case event_code("join"): trace_line->event_type = TraceEventType::JOIN; break;
+        default:
+            throw std::invalid_argument("Invalid event type");
+    }
+    std::string_view target = fields[1].substr(event_len + 1, fields[1].size() - event_len - 2);
+
+    auto thread_iter = std_thread_map.try_emplace(fields[0], std_thread_counter);
+    if (thread_iter.second) {
+        std_thread_counter += 1;
+    }
+    trace_line->thread_id = thread_iter.first->second;
+
+    bool targets_thread = trace_line->event_type == TraceEventType::FORK || trace_line->event_type == TraceEventType::JOIN;
+    auto *target_map = targets_thread ? &std_thread_map : &std_lock_id_map;
+    int *target_counter = targets_thread ? &std_thread_counter : &std_lock_id_counter;
+    auto target_iter = target_map->try_emplace(target, *target_counter);
+    if (target_iter.second) {
+        *target_counter += 1;
+    }
+    trace_line->target = target_iter.first->second;
+}
@@ -0,0 +1,78 @@
+#ifndef TRACE_PARSER_H
+#define TRACE_PARSER_H
+
+#include <cstddef>
+#include <string_view>
+#include <unordered_map>
+#include <filesystem>
+
+/**
+ * Read-only memory mapping of a whole trace file, the parser scans it in place.
+ */
+class MappedFile {
+public:
+    explicit MappedFile(const std::filesystem::path &path);
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool good() const { return is_good; }
+    const char *begin() const { return data; }
+    const char *end() const { return data + size; }
+
+private:
+    const char *data = nullptr;
+    size_t size = 0;
+    bool is_good = false;
+};
+
+// Event column of our CSV format, the std format is translated into the same events.
+enum class TraceEventType {
+    READ,           // RD, r
+    WRITE,          // WR, w
+    ACQUIRE,        // LK, acq
+    RELEASE,        // UK, rel
+    FORK,           // SIG, fork (signal in SpeedyGo traces)
+    JOIN,           // WT, join (signal wait in SpeedyGo traces)
+    NOTIFY,         // NT
+    NOTIFY_WAIT,    // NTWT
+    ATOMIC          // AWR, ARD
+};
+
+struct TraceLine {
+    int thread_id{};
+    TraceEventType event_type{};
+    int target{};
+};
+
+/**
+ * Splits a trace buffer into TraceLines without copying or allocating per line.
+ * In the std format, thread and resource names are numbered in order of first appearance starting at 1,
+ * the name tables keep views into the buffer, so it has to outlive the parser.
+ */
+class TraceParser {
+public:
+    TraceParser(const char *begin, const char *end, bool std_format);
+
+    // Parses the next line into trace_line, returns false at the end of the buffer.
+    // Throws std::invalid_argument if the line is malformed, current_line() then holds it for the error message.
+    bool next(TraceLine *trace_line);
+
+    std::string_view current_line() const { return line; }
+
+private:
+    const char *position;
+    const char *end;
+    bool std_format;
+    std::string_view line = {};
+
+    int std_thread_counter = 1;
+    std::unordered_map<std::string_view, int> std_thread_map = {};
+    int std_lock_id_counter = 1;
+    std::unordered_map<std::string_view, int> std_lock_id_map = {};
+
+    void parse_csv(TraceLine *trace_line, std::string_view fields[3]);
+    void parse_std(TraceLine *trace_line, std::string_view fields[3]);
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef SEARCHBUDGET_H
+#define SEARCHBUDGET_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include "detector.hpp"
+
+/**
+ * States and time one call of the deadlock cycle search of the UNDEAD detectors may use, as limited by the config.
+ * The workers count their states on their own and add them to the shared count in chunks, which also paces the
+ * clock reads. The limits can therefore be overrun by a chunk per worker. Every worker gets at least one state, so a
+ * search continued over several calls always makes progress.
+ * Once exhausted the budget stays so, the searches return and the detector keeps where they stopped.
+ */
+class SearchBudget {
+    public:
+        static constexpr size_t CHUNK = 1024;
+
+        explicit SearchBudget(const DetectorConfig &config)
+                : max_states(config.max_search_states),
+                  chunk(max_states != 0 && max_states < CHUNK ? max_states : CHUNK),
+                  has_deadline(config.max_search_milliseconds != 0),
+                  deadline(std::chrono::steady_clock::now() + std::chrono::milliseconds(config.max_search_milliseconds)),
+                  is_limited(max_states != 0 || has_deadline) {}
+
+        // Counts one explored state of a worker, false if the search has to stop instead.
+        bool explore(size_t *worker_states) {
+            if(!is_limited) {
+                ++*worker_states;
+                return true;
+            }
+            if(stopped.load(std::memory_order_relaxed)) {
+                return false;
+            }
+            if(++*worker_states % chunk == 0) {
+                size_t states = shared_states.fetch_add(chunk, std::memory_order_relaxed) + chunk;
+                if((max_states != 0 && states >= max_states) ||
+                   (has_deadline && std::chrono::steady_clock::now() >= deadline)) {
+                    stopped.store(true, std::memory_order_relaxed);
+                }
+            }
+            return true;
+        }
+
+        bool exhausted() const {
+            return stopped.load(std::memory_order_relaxed);
+        }
+
+    private:
+        size_t max_states;
+        size_t chunk;
+        bool has_deadline;
+        std::chrono::steady_clock::time_point deadline;
+        bool is_limited;
+        std::atomic<size_t> shared_states{0};
+        std::atomic<bool> stopped{false};
+};
+
+#endif
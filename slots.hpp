@@ -0,0 +1,163 @@
+#ifndef SLOTS_H
+#define SLOTS_H
+
+#include <algorithm>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+/**
+ * Assigns dense slots 0, 1, 2, ... to arbitrary int keys (ThreadIDs, ResourceNames) in order of first appearance.
+ * Non-negative keys below direct_limit are resolved through a plain table, only keys outside of it are hashed.
+ * The table covers the first DENSE_SIZE keys right away and only grows beyond them while it has a slot for every
+ * MAX_SPREAD entries at least, so a few large keys can't make it huge. The keys it doesn't cover are hashed.
+ */
+class SlotMap {
+    public:
+        static constexpr size_t DENSE_SIZE = 1 << 16;
+        static constexpr size_t MAX_SPREAD = 16;
+
+        explicit SlotMap(size_t direct_limit = DENSE_SIZE) : direct_limit(direct_limit) {}
+
+        // Returns the slot of key, assigns the next free one on first sight.
+        inline int slot(int key) {
+            if(static_cast<size_t>(key) < direct.size()) {
+                if(direct[key] >= 0) {
+                    return direct[key];
+                }
+                return direct[key] = add_key(key);
+            }
+            if(static_cast<size_t>(key) < direct_limit && is_dense_enough(key)) {
+                grow_direct(key);
+                // The key may have been hashed before and just moved into the table
+                if(direct[key] >= 0) {
+                    return direct[key];
+                }
+                return direct[key] = add_key(key);
+            }
+
+            auto overflow_iter = overflow.find(key);
+            if(overflow_iter != overflow.end()) {
+                return overflow_iter->second;
+            }
+            return overflow[key] = add_key(key);
+        }
+
+        // Returns the slot of key or -1 if it was never seen.
+        inline int find(int key) const {
+            if(static_cast<size_t>(key) < direct.size()) {
+                return direct[key];
+            }
+            if(overflow.empty()) {
+                return -1;
+            }
+            auto overflow_iter = overflow.find(key);
+            return overflow_iter == overflow.end() ? -1 : overflow_iter->second;
+        }
+
+        inline int key(int slot) const {
+            return keys[slot];
+        }
+
+        inline size_t size() const {
+            return keys.size();
+        }
+
+    private:
+        size_t direct_limit;
+        std::vector<int> direct = {};
+        std::unordered_map<int, int> overflow = {};
+        std::vector<int> keys = {};
+
+        inline int add_key(int key) {
+            keys.push_back(key);
+            return static_cast<int>(keys.size() - 1);
+        }
+
+        inline bool is_dense_enough(int key) const {
+            size_t size = static_cast<size_t>(key) + 1;
+            return size <= DENSE_SIZE || size <= MAX_SPREAD * (keys.size() + 1);
+        }
+
+        // Covers key and at least twice the keys covered so far, moving hashed keys into the table as it reaches them.
+        void grow_direct(int key) {
+            size_t size = std::min(direct_limit, std::max(static_cast<size_t>(key) + 1, 2 * direct.size()));
+            direct.resize(size, -1);
+            for(auto overflow_iter = overflow.begin(); overflow_iter != overflow.end();) {
+                if(static_cast<size_t>(overflow_iter->first) < size) {
+                    direct[overflow_iter->first] = overflow_iter->second;
+                    overflow_iter = overflow.erase(overflow_iter);
+                } else {
+                    ++overflow_iter;
+                }
+            }
+        }
+};
+
+/**
+ * Slot indexed storage for per-thread (or per-resource) detector state.
+ * Entries are allocated individually, so pointers handed out by find/insert stay valid while the table grows.
+ * Iteration visits the occupied slots in ascending order.
+ */
+template<typename T>
+class SlotTable {
+    public:
+        class iterator {
+            public:
+                iterator(std::unique_ptr<T> *current, std::unique_ptr<T> *end) : current(current), end(end) {
+                    skip_empty();
+                }
+                T &operator*() const { return **current; }
+                T *operator->() const { return current->get(); }
+                iterator &operator++() {
+                    ++current;
+                    skip_empty();
+                    return *this;
+                }
+                bool operator!=(const iterator &other) const { return current != other.current; }
+                bool operator==(const iterator &other) const { return current == other.current; }
+            private:
+                std::unique_ptr<T> *current;
+                std::unique_ptr<T> *end;
+                void skip_empty() {
+                    while(current != end && !*current) {
+                        ++current;
+                    }
+                }
+        };
+
+        inline T *find(int slot) {
+            return static_cast<size_t>(slot) < entries.size() ? entries[slot].get() : nullptr;
+        }
+
+        inline T *insert(int slot, T &&value) {
+            if(static_cast<size_t>(slot) >= entries.size()) {
+                entries.resize(slot + 1);
+            }
+            entries[slot] = std::make_unique<T>(std::move(value));
+            count += 1;
+            return entries[slot].get();
+        }
+
+        inline size_t size() const {
+            return count;
+        }
+
+        inline bool empty() const {
+            return count == 0;
+        }
+
+        // Upper bound for all occupied slots, usable to size slot indexed side tables.
+        inline size_t capacity() const {
+            return entries.size();
+        }
+
+        iterator begin() { return iterator(entries.data(), entries.data() + entries.size()); }
+        iterator end() { return iterator(entries.data() + entries.size(), entries.data() + entries.size()); }
+
+    private:
+        std::vector<std::unique_ptr<T>> entries = {};
+        size_t count = 0;
+};
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef TASKPOOL_H
+#define TASKPOOL_H
+
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Runs task(index, worker) for every index in [0, task_count) on worker_count threads, the calling thread being worker 0.
+ * Every worker starts with a contiguous block of the indices and takes them front to back. A worker that runs out
+ * steals the back half of another worker's block, so a few expensive tasks don't leave the other threads idle.
+ * A worker index is only used by one thread at a time, state indexed by it needs no locking.
+ * Tasks run in any order, callers that need deterministic results collect them per task index.
+ */
+template<typename F>
+void run_tasks(size_t task_count, size_t worker_count, const F &task) {
+    if(worker_count <= 1 || task_count <= 1) {
+        for(size_t i = 0; i < task_count; i++) {
+            task(i, 0);
+        }
+        return;
+    }
+    if(worker_count > task_count) {
+        worker_count = task_count;
+    }
+
+    // The remaining tasks of a worker are [next, end)
+    struct alignas(64) Block {
+        std::mutex mutex;
+        size_t next;
+        size_t end;
+    };
+    std::vector<Block> blocks(worker_count);
+    for(size_t worker = 0; worker < worker_count; worker++) {
+        blocks[worker].next = task_count * worker / worker_count;
+        blocks[worker].end = task_count * (worker + 1) / worker_count;
+    }
+
+    auto work = [&](size_t worker) {
+        Block &own = blocks[worker];
+        while(true) {
+            size_t index;
+            {
+                std::lock_guard<std::mutex> guard(own.mutex);
+                index = own.next < own.end ? own.next++ : task_count;
+            }
+            if(index < task_count) {
+                task(index, worker);
+                continue;
+            }
+
+            // Tasks are never added, once every block was seen empty all tasks are taken.
+            size_t stolen_next = 0;
+            size_t stolen_end = 0;
+            for(size_t offset = 1; offset < worker_count && stolen_next == stolen_end; offset++) {
+                Block &victim = blocks[(worker + offset) % worker_count];
+                std::lock_guard<std::mutex> victim_guard(victim.mutex);
+                if(victim.next < victim.end) {
+                    stolen_next = victim.next + (victim.end - victim.next) / 2;
+                    stolen_end = victim.end;
+                    victim.end = stolen_next;
+                }
+            }
+            if(stolen_next == stolen_end) {
+                return;
+            }
+            // Nobody steals from an empty block, so only this worker touches its block until it's refilled.
+            std::lock_guard<std::mutex> guard(own.mutex);
+            own.next = stolen_next;
+            own.end = stolen_end;
+        }
+    };
+
+    std::vector<std::thread> threads = {};
+    for(size_t worker = 1; worker < worker_count; worker++) {
+        threads.emplace_back(work, worker);
+    }
+    work(0);
+    for(auto &thread : threads) {
+        thread.join();
+    }
+}
+
+#endif
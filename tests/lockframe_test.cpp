@@ -4,9 +4,15 @@
 #include "../lockframe.hpp"
 #include "../pwrdetector.hpp"
 #include "../pwrundeaddetector.cpp"
+#include "../pwrundeadguarddetector.cpp"
 #include "../undead.hpp"
+#include "../treeclock.hpp"
+#include "../lockset.hpp"
+#include "../lockgraph.hpp"
+#include "../reader/spsc_queue.hpp"
 #include <chrono>
 #include <iostream>
+#include <thread>
 
 void compare_races(DataRace race1, DataRace race2) {
     ASSERT_EQ(race1.resource_name, race2.resource_name);
@@ -124,6 +130,120 @@ TEST(LockFramePWRTest, PaperExample_2_8) {
     paper_example_eight(lockFrame);
 }
 
+TEST(LockFramePWRTest, ThreadSlotsTranslatedBack) {
+    LockFrame* lockFrame = get_pwr_lockframe();
+
+    // Paper example one with sparse thread ids, detectors only see the slots 0 and 1
+    lockFrame->write_event(70001, 1, 1);
+    lockFrame->acquire_event(70001, 2, 2);
+    lockFrame->release_event(70001, 3, 2);
+    lockFrame->acquire_event(5, 4, 2);
+    lockFrame->write_event(5, 5, 1);
+    lockFrame->release_event(5, 6, 2);
+
+    ASSERT_EQ(lockFrame->thread_slots.size(), 2);
+    ASSERT_EQ(lockFrame->get_races().size(), 1);
+    compare_races(lockFrame->get_races().at(0), DataRace{1, 5, 5, 70001});
+}
+
+TEST(LockFramePWRTest, BatchMatchesSingleEvents) {
+    LockFrame* lockFrame = get_pwr_lockframe();
+
+    // Same trace as ThreadSlotsTranslatedBack, handed over as one batch
+    const Event events[] = {
+        {EventType::WRITE, 70001, 1, 1},
+        {EventType::ACQUIRE, 70001, 2, 2},
+        {EventType::RELEASE, 70001, 3, 2},
+        {EventType::ACQUIRE, 5, 4, 2},
+        {EventType::WRITE, 5, 5, 1},
+        {EventType::RELEASE, 5, 6, 2},
+    };
+    lockFrame->process_batch(events, 6);
+
+    ASSERT_EQ(lockFrame->get_races().size(), 1);
+    compare_races(lockFrame->get_races().at(0), DataRace{1, 5, 5, 70001});
+}
+
+TEST(LockFramePWRTest, StaticLockFrame) {
+    LockFrameT<PWRDetector> lockFrame(new PWRDetector());
+
+    lockFrame.write_event(70001, 1, 1);
+    lockFrame.acquire_event(70001, 2, 2);
+    lockFrame.release_event(70001, 3, 2);
+    const Event events[] = {
+        {EventType::ACQUIRE, 5, 4, 2},
+        {EventType::WRITE, 5, 5, 1},
+        {EventType::RELEASE, 5, 6, 2},
+    };
+    lockFrame.process_batch(events, 3);
+
+    ASSERT_EQ(lockFrame.get_races().size(), 1);
+    compare_races(lockFrame.get_races().at(0), DataRace{1, 5, 5, 70001});
+}
+
+TEST(LockFramePWRTest, RaceSinks) {
+    LockFrame* lockFrame = get_pwr_lockframe();
+    RingRaceSink ring(1);
+    std::vector<DataRace> streamed = {};
+    CallbackRaceSink callback([&streamed](const DataRace &race) { streamed.push_back(race); });
+    lockFrame->add_race_sink(&ring);
+    lockFrame->add_race_sink(&callback);
+
+    // Thread 1 reads what thread 2 wrote without synchronizing, twice
+    lockFrame->write_event(2, 1, 1);
+    lockFrame->read_event(1, 2, 1);
+    lockFrame->write_event(2, 3, 2);
+    lockFrame->read_event(1, 4, 2);
+
+    // Races went to the sinks as they were found, not into the LockFrame
+    ASSERT_EQ(streamed.size(), 2);
+    compare_races(streamed.at(1), DataRace{2, 4, 1, 2});
+    ASSERT_EQ(lockFrame->get_races().size(), 0);
+    ASSERT_EQ(lockFrame->race_count, 2);
+    ASSERT_EQ(ring.reported(), 2);
+    ASSERT_EQ(ring.races().size(), 1);
+    compare_races(ring.races().at(0), streamed.at(1));
+}
+
+TEST(RaceAggregatorTest, CountsDistinctRaces) {
+    RaceAggregator aggregator(RaceAggregationKey::RESOURCE_AND_THREAD_PAIR);
+    // 100 resources raced on by the same threads in both orders, enough to grow the table
+    for(int position = 0; position < 1000; position++) {
+        bool swapped = position % 2 == 1;
+        aggregator.report(DataRace{position % 100, position, swapped ? 2 : 1, swapped ? 1 : 2});
+    }
+
+    ASSERT_EQ(aggregator.races().size(), 100);
+    compare_races(aggregator.races().at(3).first, DataRace{3, 3, 2, 1});
+    ASSERT_EQ(aggregator.races().at(3).last_position, 903);
+    ASSERT_EQ(aggregator.races().at(3).count, 10);
+
+    RaceAggregator by_threads(RaceAggregationKey::THREAD_PAIR);
+    by_threads.report(DataRace{1, 1, 1, 2});
+    by_threads.report(DataRace{2, 2, 2, 1});
+    ASSERT_EQ(by_threads.races().size(), 1);
+}
+
+TEST(LockFramePWRTest, ThreadLocalResourceTurnsShared) {
+    LockFrame* lockFrame = get_pwr_lockframe();
+
+    // x stays in the single-thread fast path until thread 2 touches it
+    lockFrame->write_event(1, 1, 1);
+    lockFrame->read_event(1, 2, 1);
+    lockFrame->write_event(1, 3, 1);
+    lockFrame->read_event(1, 4, 1);
+    ASSERT_EQ(lockFrame->get_races().size(), 0);
+
+    lockFrame->write_event(2, 5, 1);
+    ASSERT_EQ(lockFrame->get_races().size(), 1);
+    compare_races(lockFrame->get_races().at(0), DataRace{1, 5, 2, 1});
+
+    // Thread 1 never synchronized with thread 2, so its next read races with thread 2's write
+    lockFrame->read_event(1, 6, 1);
+    ASSERT_EQ(lockFrame->get_races().size(), 2);
+    compare_races(lockFrame->get_races().at(1), DataRace{1, 6, 1, 2});
+}
+
 TEST(LockFrameUNDEADTest, Test1) {
     LockFrame* lockFrame = get_pwr_undead_lockframe();
 
@@ -139,6 +259,201 @@ TEST(LockFrameUNDEADTest, Test1) {
     ASSERT_EQ(lockFrame->get_races().size(), 1);
 }
 
+TEST(LockFrameUNDEADTest, OnlineReportsCycleWhenComplete) {
+    DetectorConfig config;
+    config.online_deadlock_detection = true;
+    LockFrameT<UNDEADDetector> lockFrame(new UNDEADDetector(), config);
+    VectorRaceSink sink;
+    lockFrame.add_race_sink(&sink);
+
+    // T3: 1 -> 2, T2: 2 -> 3, T1: 3 -> 1
+    lockFrame.acquire_event(3, 1, 1);
+    lockFrame.acquire_event(3, 2, 2);
+    lockFrame.release_event(3, 3, 2);
+    lockFrame.release_event(3, 4, 1);
+    lockFrame.acquire_event(2, 5, 2);
+    lockFrame.acquire_event(2, 6, 3);
+    lockFrame.release_event(2, 7, 3);
+    lockFrame.release_event(2, 8, 2);
+    lockFrame.acquire_event(1, 9, 3);
+    ASSERT_EQ(sink.races.size(), 0);
+    lockFrame.acquire_event(1, 10, 1);
+
+    // Reported as soon as the last dependency appears, starting at the thread seen first like the search after the trace
+    ASSERT_EQ(sink.races.size(), 1);
+    compare_races(sink.races.at(0), DataRace{1, 10, 3, 1});
+    lockFrame.get_races();
+    ASSERT_EQ(sink.races.size(), 1);
+}
+
+// Lock pairs taken in opposite orders by four threads, a few dozen chains to search
+void lock_order_inversions(LockFrame* lockFrame) {
+    const int orders[4][3][2] = {{{1, 2}, {2, 3}, {3, 4}}, {{2, 1}, {3, 1}, {4, 2}},
+                                 {{3, 2}, {1, 3}, {4, 1}}, {{2, 1}, {3, 2}, {4, 3}}};
+    TracePosition position = 1;
+    for (int thread = 0; thread < 4; thread++) {
+        for (auto &order : orders[thread]) {
+            lockFrame->acquire_event(thread + 1, position++, order[0]);
+            lockFrame->acquire_event(thread + 1, position++, order[1]);
+            lockFrame->release_event(thread + 1, position++, order[1]);
+            lockFrame->release_event(thread + 1, position++, order[0]);
+        }
+    }
+}
+
+template<typename D>
+std::vector<DataRace> lock_order_inversion_races(size_t worker_threads) {
+    DetectorConfig config;
+    config.worker_threads = worker_threads;
+    LockFrame lockFrame;
+    lockFrame.set_detector(new D(), config);
+    lock_order_inversions(&lockFrame);
+    return lockFrame.get_races();
+}
+
+template<typename D>
+void expect_same_races_on_workers() {
+    std::vector<DataRace> expected = lock_order_inversion_races<D>(1);
+    ASSERT_GT(expected.size(), 0);
+    std::vector<DataRace> races = lock_order_inversion_races<D>(4);
+    ASSERT_EQ(races.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        compare_races(races.at(i), expected.at(i));
+    }
+}
+
+TEST(LockFrameUNDEADTest, WorkersFindSameCycles) {
+    expect_same_races_on_workers<UNDEADDetector>();
+    expect_same_races_on_workers<PWRUNDEADDetector>();
+    expect_same_races_on_workers<PWRUNDEADGuardDetector>();
+}
+
+template<typename D>
+void expect_resumed_search_complete(size_t worker_threads = 1) {
+    LockFrame unlimited;
+    unlimited.set_detector(new D());
+    lock_order_inversions(&unlimited);
+    std::vector<DataRace> expected = unlimited.get_races();
+    ASSERT_TRUE(unlimited.detector->is_complete());
+    ASSERT_GT(expected.size(), 0);
+
+    DetectorConfig config;
+    config.max_search_states = 1;
+    config.worker_threads = worker_threads;
+    LockFrame limited;
+    limited.set_detector(new D(), config);
+    lock_order_inversions(&limited);
+    limited.get_races();
+    ASSERT_FALSE(limited.detector->is_complete());
+    size_t calls = 1;
+    while (!limited.detector->is_complete()) {
+        limited.get_races();
+        calls++;
+    }
+    // Every worker gets a state per call at least
+    ASSERT_GT(calls * worker_threads, expected.size());
+    ASSERT_EQ(limited.get_races().size(), expected.size());
+    // The checkpoints keep the search order, only the calls split it up
+    for (size_t i = 0; i < expected.size(); i++) {
+        compare_races(limited.races.at(i), expected.at(i));
+    }
+}
+
+TEST(LockFrameUNDEADTest, ResumedSearchFindsEveryCycle) {
+    expect_resumed_search_complete<UNDEADDetector>();
+    expect_resumed_search_complete<PWRUNDEADDetector>();
+}
+
+TEST(LockFrameUNDEADTest, ResumedSearchWithWorkersFindsEveryCycle) {
+    expect_resumed_search_complete<UNDEADDetector>(3);
+    expect_resumed_search_complete<PWRUNDEADDetector>(3);
+}
+
+// T1 takes 2 while holding 1, once with and once without 3, T2 takes them the other way around: one cycle, two chains
+void repeated_cycle(LockFrame* lockFrame) {
+    lockFrame->acquire_event(1, 1, 1);
+    lockFrame->acquire_event(1, 2, 2);
+    lockFrame->release_event(1, 3, 2);
+    lockFrame->release_event(1, 4, 1);
+    lockFrame->acquire_event(1, 5, 3);
+    lockFrame->acquire_event(1, 6, 1);
+    lockFrame->acquire_event(1, 7, 2);
+    lockFrame->release_event(1, 8, 2);
+    lockFrame->release_event(1, 9, 1);
+    lockFrame->release_event(1, 10, 3);
+    lockFrame->acquire_event(2, 11, 2);
+    lockFrame->acquire_event(2, 12, 1);
+    lockFrame->release_event(2, 13, 1);
+    lockFrame->release_event(2, 14, 2);
+}
+
+template<typename D>
+void expect_cycle_reported_once() {
+    LockFrame every_chain;
+    every_chain.set_detector(new D());
+    repeated_cycle(&every_chain);
+    ASSERT_EQ(every_chain.get_races().size(), 2);
+
+    DetectorConfig config;
+    config.unique_cycles = true;
+    LockFrame unique;
+    unique.set_detector(new D(), config);
+    repeated_cycle(&unique);
+    ASSERT_EQ(unique.get_races().size(), 1);
+    compare_races(unique.races.at(0), every_chain.races.at(0));
+}
+
+TEST(LockFrameUNDEADTest, UniqueCyclesReportedOnce) {
+    expect_cycle_reported_once<UNDEADDetector>();
+    expect_cycle_reported_once<PWRUNDEADDetector>();
+}
+
+// As many aggregated races as unique cycles, every report of a cycle counted on its entry
+template<typename D>
+void expect_cycles_aggregated(void (*trace)(LockFrame*), bool online = false) {
+    DetectorConfig unique_config;
+    unique_config.unique_cycles = true;
+    unique_config.online_deadlock_detection = online;
+    LockFrame unique;
+    unique.set_detector(new D(), unique_config);
+    trace(&unique);
+    size_t cycles = unique.get_races().size();
+
+    DetectorConfig config;
+    config.identify_cycles = true;
+    config.online_deadlock_detection = online;
+    LockFrame lockFrame;
+    lockFrame.set_detector(new D(), config);
+    RaceAggregator aggregator(RaceAggregationKey::LOCK_CYCLE);
+    lockFrame.add_race_sink(&aggregator);
+    trace(&lockFrame);
+    lockFrame.get_races();
+
+    ASSERT_EQ(aggregator.races().size(), cycles);
+    size_t reports = 0;
+    for (auto &race : aggregator.races()) {
+        ASSERT_NE(race.first.cycle, 0);
+        reports += race.count;
+    }
+    ASSERT_EQ(reports, lockFrame.race_count);
+}
+
+TEST(RaceAggregatorTest, FoldsLockCycles) {
+    expect_cycles_aggregated<UNDEADDetector>(repeated_cycle);
+    expect_cycles_aggregated<UNDEADDetector>(lock_order_inversions);
+    expect_cycles_aggregated<UNDEADDetector>(lock_order_inversions, true);
+    expect_cycles_aggregated<PWRUNDEADDetector>(repeated_cycle);
+    expect_cycles_aggregated<PWRUNDEADDetector>(lock_order_inversions);
+    expect_cycles_aggregated<PWRUNDEADGuardDetector>(lock_order_inversions);
+
+    // Data races keep their resource and thread pair
+    RaceAggregator by_cycle(RaceAggregationKey::LOCK_CYCLE);
+    by_cycle.report(DataRace{1, 1, 1, 2});
+    by_cycle.report(DataRace{1, 2, 2, 1});
+    by_cycle.report(DataRace{2, 3, 1, 2});
+    ASSERT_EQ(by_cycle.races().size(), 2);
+}
+
 TEST(LockFramePWRUNDEADTest, PwrUndeadExtensionExample1) {
     LockFrame* lockFrame = get_pwr_undead_lockframe();
 
@@ -226,7 +541,317 @@ TEST(LockFramePWRUNDEADTest, PwrUndeadExtensionExample5) {
     ASSERT_EQ(lockFrame->get_races().size(), 1);
 }
 
+template<typename D>
+void expect_zero_clocks_per_dependency_keeps_one() {
+    std::vector<std::vector<DataRace>> races = {};
+    for (size_t limit : {0, 1}) {
+        DetectorConfig config;
+        config.vector_clocks_per_dependency = limit;
+        LockFrame lockFrame;
+        lockFrame.set_detector(new D(), config);
+        lock_order_inversions(&lockFrame);
+        lock_order_inversions(&lockFrame);
+        races.push_back(lockFrame.get_races());
+    }
+    ASSERT_GT(races[1].size(), 0);
+    ASSERT_EQ(races[0].size(), races[1].size());
+    for (size_t i = 0; i < races[1].size(); i++) {
+        compare_races(races[0].at(i), races[1].at(i));
+    }
+}
+
+TEST(LockFramePWRUNDEADTest, ZeroClocksPerDependencyKeepsOne) {
+    expect_zero_clocks_per_dependency_keeps_one<PWRUNDEADDetector>();
+    expect_zero_clocks_per_dependency_keeps_one<PWRUNDEADGuardDetector>();
+}
+
+TEST(VectorClockTest, DenseMergeAndCompare) {
+    // 11 entries cover the 8 and 4 lane loops as well as the scalar tail
+    VectorClock vc1 = {};
+    VectorClock vc2 = {};
+    for(ThreadID i = 0; i < 11; i++) {
+        vc1.set(i, i + 1);
+        vc2.set(i, i + 1);
+    }
+    vc2.increment(10);
+
+    ASSERT_TRUE(vc1.less_than(&vc2));
+    ASSERT_TRUE(vc1.less_than_or_equal(&vc2));
+    ASSERT_FALSE(vc2.less_than(&vc1));
+    ASSERT_FALSE(vc1.less_than(&vc1));
+    ASSERT_TRUE(vc1.less_than_or_equal(&vc1));
+
+    vc1.set(13, 1);
+    ASSERT_FALSE(vc1.less_than_or_equal(&vc2));
+
+    vc2.merge_into(&vc1);
+    ASSERT_EQ(vc2.find(10), 12);
+    ASSERT_EQ(vc2.find(13), 1);
+    ASSERT_EQ(vc2.find(12), 0);
+    ASSERT_TRUE(vc1.less_than(&vc2));
+}
+
+TEST(TreeClockTest, MatchesVectorClock) {
+    // Random synchronization between threads, partly through stale copies like the lock histories keep them
+    const ThreadID thread_count = 12;
+    std::vector<TreeClock> tree_clocks = {};
+    std::vector<VectorClock> vector_clocks = {};
+    for(ThreadID i = 0; i < thread_count; i++) {
+        tree_clocks.push_back(TreeClock(i));
+        vector_clocks.push_back(VectorClock(i));
+    }
+    std::vector<std::pair<TreeClock, VectorClock>> copies = {};
+
+    unsigned int seed = 42;
+    auto next_random = [&seed](unsigned int bound) {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16) % bound;
+    };
+
+    for(int step = 0; step < 5000; step++) {
+        ThreadID thread = next_random(thread_count);
+        switch(next_random(4)) {
+            case 0:
+                tree_clocks[thread].increment(thread);
+                vector_clocks[thread].increment(thread);
+                break;
+            case 1: {
+                ThreadID other = next_random(thread_count);
+                tree_clocks[thread].merge_into(&tree_clocks[other]);
+                vector_clocks[thread].merge_into(&vector_clocks[other]);
+                break;
+            }
+            case 2:
+                copies.push_back({ tree_clocks[thread], vector_clocks[thread] });
+                break;
+            case 3:
+                if(!copies.empty()) {
+                    auto &copy = copies[next_random(copies.size())];
+                    tree_clocks[thread].merge_into(&copy.first);
+                    vector_clocks[thread].merge_into(&copy.second);
+                }
+                break;
+        }
+
+        for(ThreadID i = 0; i < thread_count; i++) {
+            ASSERT_EQ(tree_clocks[thread].find(i), vector_clocks[thread].find(i));
+        }
+        ThreadID other = next_random(thread_count);
+        ASSERT_EQ(tree_clocks[thread].less_than_or_equal(&tree_clocks[other]), vector_clocks[thread].less_than_or_equal(&vector_clocks[other]));
+    }
+
+    // Fork: the child continues on a copy of the parent's clock
+    TreeClock child = tree_clocks[0];
+    VectorClock child_vc = vector_clocks[0];
+    child.increment(thread_count);
+    child_vc.increment(thread_count);
+    tree_clocks[1].merge_into(&child);
+    vector_clocks[1].merge_into(&child_vc);
+    for(ThreadID i = 0; i <= thread_count; i++) {
+        ASSERT_EQ(tree_clocks[1].find(i), vector_clocks[1].find(i));
+    }
+}
+
+TEST(TreeClockTest, ForkRunningThread) {
+    // Forks like the detectors do them, also into threads that already run and whose clocks others have copied
+    const ThreadID thread_count = 6;
+    std::vector<TreeClock> tree_clocks = {};
+    std::vector<VectorClock> vector_clocks = {};
+    for(ThreadID i = 0; i < thread_count; i++) {
+        tree_clocks.push_back(TreeClock(i));
+        vector_clocks.push_back(VectorClock(i));
+    }
+    std::vector<std::pair<TreeClock, VectorClock>> copies = {};
+
+    unsigned int seed = 7;
+    auto next_random = [&seed](unsigned int bound) {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16) % bound;
+    };
+
+    for(int step = 0; step < 5000; step++) {
+        ThreadID thread = next_random(thread_count);
+        ThreadID other = next_random(thread_count);
+        switch(next_random(4)) {
+            case 0:
+                tree_clocks[thread].increment(thread);
+                vector_clocks[thread].increment(thread);
+                copies.push_back({ tree_clocks[thread], vector_clocks[thread] });
+                break;
+            case 1:
+                tree_clocks[thread].merge_into(&tree_clocks[other]);
+                vector_clocks[thread].merge_into(&vector_clocks[other]);
+                break;
+            case 2:
+                if(other != thread) {
+                    tree_clocks[other].merge_into(&tree_clocks[thread]);
+                    tree_clocks[other].increment(other);
+                    tree_clocks[thread].increment(thread);
+                    vector_clocks[other].merge_into(&vector_clocks[thread]);
+                    vector_clocks[other].increment(other);
+                    vector_clocks[thread].increment(thread);
+                }
+                break;
+            case 3:
+                if(!copies.empty()) {
+                    auto &copy = copies[next_random(copies.size())];
+                    tree_clocks[thread].merge_into(&copy.first);
+                    vector_clocks[thread].merge_into(&copy.second);
+                }
+                break;
+        }
+
+        for(ThreadID i = 0; i < thread_count; i++) {
+            ASSERT_EQ(tree_clocks[thread].find(i), vector_clocks[thread].find(i));
+            ASSERT_EQ(tree_clocks[other].find(i), vector_clocks[other].find(i));
+        }
+    }
+}
+
+TEST(LockGraphTest, OnlyCyclesFormComponents) {
+    auto lockset = [](std::vector<LockIndex> locks) {
+        LockSet result = {};
+        for(LockIndex lock : locks) {
+            result.insert(lock);
+        }
+        return result;
+    };
+
+    // 0 -> 1 -> 2 -> 0 is a cycle, 3 only follows it and 4 -> 4 is a reentrant acquire
+    LockGraph graph = {};
+    graph.add_dependency(lockset({0}), 1);
+    graph.add_dependency(lockset({1}), 2);
+    graph.add_dependency(lockset({2}), 0);
+    graph.add_dependency(lockset({0, 2}), 3);
+    graph.add_dependency(lockset({4}), 4);
+    graph.find_components();
+
+    ASSERT_EQ(graph.size(), 1);
+    ASSERT_NE(graph.component(0), LockGraph::NO_COMPONENT);
+    ASSERT_EQ(graph.component(1), graph.component(0));
+    ASSERT_EQ(graph.component(2), graph.component(0));
+    ASSERT_EQ(graph.component(3), LockGraph::NO_COMPONENT);
+    ASSERT_EQ(graph.component(4), LockGraph::NO_COMPONENT);
+    ASSERT_TRUE(graph.may_deadlock(lockset({0, 3}), 1));
+    ASSERT_FALSE(graph.may_deadlock(lockset({3}), 1));
+}
+
+TEST(LockSetTest, InlineAndOverflowWords) {
+    LockSet ls1 = {};
+    LockSet ls2 = {};
+    ls1.insert(3);
+    ls1.insert(130);
+    ls2.insert(64);
+    ls2.insert(300);
+
+    ASSERT_EQ(ls1.size(), 2);
+    ASSERT_TRUE(ls1.contains(130));
+    ASSERT_FALSE(ls1.contains(64));
+    ASSERT_FALSE(ls1.overlaps(ls2));
+
+    ls2.insert(130);
+    ASSERT_TRUE(ls1.overlaps(ls2));
+
+    LockSet difference = ls2.difference(ls1);
+    std::vector<LockIndex> locks = {};
+    for(LockIndex lock : difference) {
+        locks.push_back(lock);
+    }
+    ASSERT_EQ(locks, std::vector<LockIndex>({64, 300}));
+
+    // Erasing the only overflow lock makes the set equal to an inline-only one again
+    ls1.erase(130);
+    LockSet ls3 = {};
+    ls3.insert(3);
+    ASSERT_TRUE(ls1 == ls3);
+    ASSERT_FALSE(ls1 < ls3 || ls3 < ls1);
+}
+
+TEST(LockSetTest, TableInternsEqualSets) {
+    LockSetTable table = {};
+    LockSetID a = table.with(LockSetTable::EMPTY, 5);
+    LockSetID ab = table.with(a, 200);
+    LockSetID b = table.with(LockSetTable::EMPTY, 200);
+
+    ASSERT_EQ(table.with(b, 5), ab);
+    ASSERT_EQ(table.without(ab, 200), a);
+    ASSERT_EQ(table.without(a, 5), LockSetTable::EMPTY);
+    ASSERT_EQ(table.size(), 4);
+    ASSERT_TRUE(table.get(ab).contains(200));
+}
+
+TEST(SlotMapTest, SparseKeysKeepTheirSlots) {
+    SlotMap slots(1 << 24);
+    // A few large keys stay hashed, the dense ones after them pull the small large key into the table
+    ASSERT_EQ(slots.slot(10000000), 0);
+    ASSERT_EQ(slots.slot(100000), 1);
+    ASSERT_EQ(slots.slot(-5), 2);
+    for(int key = 0; key < 70000; key++) {
+        ASSERT_EQ(slots.slot(key), key + 3);
+    }
+    ASSERT_EQ(slots.find(100000), 1);
+    ASSERT_EQ(slots.slot(100000), 1);
+    ASSERT_EQ(slots.find(10000000), 0);
+    ASSERT_EQ(slots.find(-5), 2);
+    ASSERT_EQ(slots.find(70000), -1);
+    ASSERT_EQ(slots.find(9999999), -1);
+    ASSERT_EQ(slots.key(1), 100000);
+    ASSERT_EQ(slots.size(), 70003);
+}
+
+TEST(SlotMapTest, HashedKeyGrowingTheTableKeepsItsSlot) {
+    SlotMap slots(1 << 24);
+    ASSERT_EQ(slots.slot(100000), 0);
+    for(int key = 0; key < 6300; key++) {
+        ASSERT_EQ(slots.slot(key), key + 1);
+    }
+    // Dense enough now, the hashed key itself makes the table grow over it
+    ASSERT_EQ(slots.size(), 6301);
+    ASSERT_EQ(slots.slot(100000), 0);
+    ASSERT_EQ(slots.find(100000), 0);
+    ASSERT_EQ(slots.size(), 6301);
+}
+
+TEST(SpscQueueTest, KeepsOrderAcrossFullAndEmpty) {
+    // Far more elements than fit, the producer has to wait for the consumer and the other way around
+    const int count = 100000;
+    SpscQueue<int> queue(4);
+    std::thread producer([&queue]() {
+        for(int value = 0; value < count; value++) {
+            queue.push(value);
+        }
+        queue.close();
+    });
+
+    // Checked once the producer is joined, a failed assertion returns right away
+    std::vector<int> received = {};
+    size_t largest_pop = 0;
+    int popped[3];
+    for(size_t popped_count; (popped_count = queue.pop(popped, 3)) != 0;) {
+        largest_pop = std::max(largest_pop, popped_count);
+        received.insert(received.end(), popped, popped + popped_count);
+    }
+    producer.join();
+
+    ASSERT_LE(largest_pop, 3);
+    ASSERT_EQ(received.size(), count);
+    for(int value = 0; value < count; value++) {
+        ASSERT_EQ(received[value], value);
+    }
+    // Stays closed and empty
+    ASSERT_EQ(queue.pop(popped, 3), 0);
+    SpscQueue<int>::Statistics statistics = queue.statistics();
+    ASSERT_EQ(statistics.capacity, 4);
+    ASSERT_GT(statistics.full_waits, 0);
+    ASSERT_GE(statistics.occupancy_sum, count);
+
+    // Closed before anything was pushed
+    SpscQueue<int> empty(4);
+    empty.close();
+    ASSERT_EQ(empty.pop(popped, 3), 0);
+}
+
 int main(int argc, char **argv) {
     testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
-}
\ No newline at end of file
+}
@@ -0,0 +1,152 @@
+#include "treeclock.hpp"
+
+TreeClock::TreeClock() {}
+TreeClock::TreeClock(ThreadID increment_thread_id) {
+    this->set(increment_thread_id, 1);
+}
+
+std::vector<Epoch> TreeClock::find_all() const {
+    return values.find_all();
+}
+
+TreeClock TreeClock::merge(const TreeClock &tree_clock) const {
+    TreeClock new_tree_clock = *this;
+    new_tree_clock.merge_into(&tree_clock);
+    return new_tree_clock;
+}
+
+void TreeClock::reserve_nodes(size_t size) {
+    if(nodes.size() < size) {
+        nodes.resize(size, Node{ 0, 0, NONE, NONE, NONE, NONE });
+    }
+}
+
+void TreeClock::detach(ThreadID node) {
+    Node &detached = nodes[node];
+    if(detached.previous_sibling != NONE) {
+        nodes[detached.previous_sibling].next_sibling = detached.next_sibling;
+    } else {
+        nodes[detached.parent].first_child = detached.next_sibling;
+    }
+    if(detached.next_sibling != NONE) {
+        nodes[detached.next_sibling].previous_sibling = detached.previous_sibling;
+    }
+    detached.parent = NONE;
+    detached.next_sibling = NONE;
+    detached.previous_sibling = NONE;
+}
+
+void TreeClock::push_child(ThreadID parent_node, ThreadID node, Version attached_at_version) {
+    Node &attached = nodes[node];
+    ThreadID next_sibling = nodes[parent_node].first_child;
+    attached.parent = parent_node;
+    attached.attached_at = attached_at_version;
+    attached.previous_sibling = NONE;
+    attached.next_sibling = next_sibling;
+    if(next_sibling != NONE) {
+        nodes[next_sibling].previous_sibling = node;
+    }
+    nodes[parent_node].first_child = node;
+}
+
+/**
+ * Makes thread_id the owner of this clock, e.g. when a forked thread continues on a copy of its parent's clock.
+ * The previous root keeps its subtree and becomes the newest child of the new root.
+ */
+void TreeClock::make_root(ThreadID thread_id) {
+    reserve_nodes(thread_id + 1);
+    ThreadID old_root = root;
+    if(contains(thread_id)) {
+        detach(thread_id);
+    }
+
+    root = thread_id;
+    nodes[thread_id].version += 1;
+    if(old_root != NONE) {
+        push_child(thread_id, old_root, nodes[thread_id].version);
+    }
+}
+
+void TreeClock::set(ThreadID thread_id, VectorClockValue value) {
+    if(thread_id == root) {
+        nodes[root].version += 1;
+    } else {
+        make_root(thread_id);
+    }
+    values.set(thread_id, value);
+}
+
+void TreeClock::increment(ThreadID thread_id) {
+    if(thread_id == root) {
+        nodes[root].version += 1;
+    } else {
+        make_root(thread_id);
+    }
+    values.increment(thread_id);
+}
+
+/**
+ * Collects the nodes of tree_clock that are newer than ours in post order.
+ * Children are sorted by attach time, once a child was attached before the version of its parent we already know,
+ * neither it nor any of its older siblings can carry news.
+ */
+void TreeClock::collect_updated_nodes(const TreeClock* tree_clock, ThreadID node) {
+    Version known_version = version_of(node);
+
+    for(ThreadID child = tree_clock->nodes[node].first_child; child != NONE; child = tree_clock->nodes[child].next_sibling) {
+        const Node &source_child = tree_clock->nodes[child];
+        if(version_of(child) < source_child.version) {
+            collect_updated_nodes(tree_clock, child);
+        } else if(source_child.attached_at <= known_version) {
+            break;
+        }
+    }
+
+    update_stack.push_back(node);
+}
+
+void TreeClock::merge_into(const TreeClock* tree_clock) {
+    ThreadID source_root = tree_clock->root;
+    if(source_root == NONE || tree_clock->nodes[source_root].version <= version_of(source_root)) {
+        return;
+    }
+    if(root == NONE) {
+        *this = *tree_clock;
+        return;
+    }
+
+    reserve_nodes(tree_clock->nodes.size());
+    update_stack.clear();
+    collect_updated_nodes(tree_clock, source_root);
+
+    // Our state changes, so anything learned from now on gets a new version of the root.
+    nodes[root].version += 1;
+
+    for(ThreadID node : update_stack) {
+        if(contains(node)) {
+            detach(node);
+        }
+    }
+
+    // Reverse post order attaches every parent before its children and older siblings before newer ones.
+    for(auto node_iter = update_stack.rbegin(); node_iter != update_stack.rend(); ++node_iter) {
+        ThreadID node = *node_iter;
+        const Node &source_node = tree_clock->nodes[node];
+        nodes[node].version = source_node.version;
+        values.set(node, tree_clock->values.find(node));
+
+        if(node == source_root) {
+            push_child(root, node, nodes[root].version);
+        } else {
+            push_child(source_node.parent, node, source_node.attached_at);
+        }
+    }
+}
+
+bool TreeClock::less_than(const TreeClock* tree_clock) const {
+    return values.less_than(&tree_clock->values);
+}
+
+bool TreeClock::less_than_or_equal(const TreeClock* tree_clock) const {
+    return values.less_than_or_equal(&tree_clock->values);
+}
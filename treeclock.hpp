@@ -0,0 +1,69 @@
+#ifndef TREECLOCK_H
+#define TREECLOCK_H
+
+#include <vector>
+#include "lockframe.hpp"
+#include "vectorclock.hpp"
+#include "vectorclock_types.hpp"
+
+/**
+ * Tree clock (Mathur et al., "Tree Clocks: Efficient Timestamp Maintenance", ASPLOS '22) with the interface of VectorClock.
+ *
+ * The clock of thread t is a tree rooted at t. Every node remembers from which thread's clock its entry was learned
+ * and at which point (aclk), so merge_into only walks the entries that changed since the last synchronization
+ * instead of all threads. The tree is ordered by a per-thread version that grows on every change of the owner's
+ * clock (increments and joins), the values returned by find() are exactly the ones a VectorClock would hold.
+ *
+ * Contract: merge_into, increment and set are only called on the clock owned by a thread, all other clocks are
+ * copies of thread clocks. Detectors that merge into shared clocks (e.g. notify) have to join into the thread and
+ * copy back instead.
+ */
+class TreeClock {
+    public:
+        TreeClock();
+        TreeClock(ThreadID increment_thread_id);
+        inline VectorClockValue find(ThreadID thread_id) const {
+            return values.find(thread_id);
+        }
+        std::vector<Epoch> find_all() const;
+        TreeClock merge(const TreeClock &tree_clock) const;
+        void merge_into(const TreeClock* tree_clock);
+        void set(ThreadID thread_id, VectorClockValue value);
+        void increment(ThreadID thread_id);
+        bool less_than(const TreeClock* tree_clock) const;
+        bool less_than_or_equal(const TreeClock* tree_clock) const;
+
+    private:
+        typedef int Version;
+        static constexpr ThreadID NONE = -1;
+
+        struct Node {
+            Version version;
+            // Version of the parent at the time this entry was attached, children are sorted by it in descending order.
+            Version attached_at;
+            ThreadID parent;
+            ThreadID first_child;
+            ThreadID next_sibling;
+            ThreadID previous_sibling;
+        };
+
+        // Entries as seen through find(), kept dense for the vectorized comparisons.
+        VectorClock values = {};
+        ThreadID root = NONE;
+        std::vector<Node> nodes = {};
+        std::vector<ThreadID> update_stack = {};
+
+        inline Version version_of(ThreadID thread_id) const {
+            return static_cast<size_t>(thread_id) < nodes.size() ? nodes[thread_id].version : 0;
+        }
+        inline bool contains(ThreadID thread_id) const {
+            return thread_id == root || (static_cast<size_t>(thread_id) < nodes.size() && nodes[thread_id].parent != NONE);
+        }
+        void reserve_nodes(size_t size);
+        void make_root(ThreadID thread_id);
+        void collect_updated_nodes(const TreeClock* tree_clock, ThreadID node);
+        void detach(ThreadID node);
+        void push_child(ThreadID parent_node, ThreadID node, Version attached_at_version);
+};
+
+#endif
@@ -1,133 +1,369 @@
 #include "undead.hpp"
 #include <chrono>
+#include "taskpool.hpp"
 
-void UNDEADDetector::find_cycles()
+void UNDEADDetector::prepare_search()
 {
-    std::set<ThreadID> thread_ids = {};
-    std::unordered_map<ThreadID, bool> is_traversed = {};
-    for (auto const &thread : threads)
+    lock_graph = {};
+    for (auto &thread : threads)
     {
-        thread_ids.insert(thread.first);
-        is_traversed[thread.first] = false;
+        for (auto &d : thread.dependencies)
+        {
+            for (auto &l : d.second)
+            {
+                lock_graph.add_dependency(locksets.get(d.first), l.first);
+            }
+        }
     }
+    lock_graph.find_components();
 
-    int visiting;
-    std::vector<LockDependency> chain_stack = {};
-    for (auto thread_id = thread_ids.cbegin(); thread_id != thread_ids.cend(); ++thread_id)
+    // Every dependency that may be part of a deadlock starts a search of its own and can extend the chains of others.
+    starts.clear();
+    dependency_index.clear();
+    for (auto &thread : threads)
     {
-        Thread *thread = get_thread(*thread_id);
-        if (thread->dependencies.empty())
-            continue;
-        visiting = *thread_id;
-
-        for (auto &d : thread->dependencies)
+        for (auto &d : thread.dependencies)
         {
             for (auto &l : d.second)
             {
-                is_traversed[*thread_id] = true;
-                chain_stack.push_back(LockDependency{
-                    *thread_id,
+                if (!lock_graph.may_deadlock(locksets.get(d.first), l.first))
+                    continue;
+                starts.push_back(LockDependency{
+                    thread.id,
                     l.first,
-                    &d.first});
-                dfs(&chain_stack, visiting, &is_traversed, &thread_ids);
-                chain_stack.pop_back();
+                    &locksets.get(d.first)});
+                dependency_index.add(locksets.get(d.first), starts.back());
             }
         }
     }
+
+    pending_starts.clear();
+    for (size_t i = 0; i < starts.size(); i++)
+    {
+        pending_starts.push_back(PendingStart{i, {}, false, {}});
+    }
+    chains_cut = false;
+    search_prepared = true;
+
+#ifdef COLLECT_STATISTICS
+    this->lockframe->report_statistic("Lock graph components with cycles", lock_graph.size());
+    this->lockframe->report_statistic("Phase 2 start dependencies", starts.size());
+#endif
 }
 
-void UNDEADDetector::dfs(std::vector<LockDependency> *chain_stack, int visiting_thread_id, std::unordered_map<ThreadID, bool> *is_traversed, std::set<ThreadID> *thread_ids)
+void UNDEADDetector::find_cycles()
 {
-    for (auto thread_id = thread_ids->cbegin(); thread_id != thread_ids->cend(); ++thread_id)
+    if (!search_prepared)
+        prepare_search();
+
+    // The searches only read the dependencies and run on the worker threads.
+    SearchBudget budget(config);
+    CycleSearch prototype = {};
+    prototype.is_traversed.assign(threads.capacity(), false);
+    // A chain has a dependency per thread at most
+    prototype.searched.resize(threads.capacity() + 1);
+    std::vector<CycleSearch> searches(std::max<size_t>(config.worker_threads, 1), prototype);
+    run_tasks(pending_starts.size(), searches.size(), [&](size_t task, size_t worker) {
+        PendingStart &pending = pending_starts[task];
+        if (pending.is_finished || budget.exhausted())
+            return;
+        CycleSearch &search = searches[worker];
+        const LockDependency &start = starts[pending.start];
+        ThreadID visiting = start.id;
+        search.is_traversed[visiting] = true;
+        search.chain_stack.push_back(start);
+        search.resume = std::move(pending.path);
+        search.path.clear();
+        search.cycles.clear();
+        pending.is_finished = dfs(&search, visiting, &budget, &pending.found);
+        pending.path = std::move(search.path);
+        search.chain_stack.pop_back();
+        search.is_traversed[visiting] = false;
+    });
+
+    // Reported in the order of the starts, as a single thread would find them: up to the first interrupted start,
+    // the starts after it keep what they found for the next call, which continues where the searches stopped.
+    std::vector<PendingStart> unfinished = {};
+    bool in_order = true;
+    for (size_t task = 0; task < pending_starts.size(); task++)
     {
-        if (*thread_id <= visiting_thread_id)
-            continue;
-        Thread *thread = get_thread(*thread_id);
-        if (thread->dependencies.empty())
-            continue;
+        PendingStart &pending = pending_starts[task];
+        if (in_order)
+        {
+            StartResult &result = pending.found;
+            for (size_t i = 0; i < result.races.size(); i++)
+            {
+                // Other starts may have found the cycle as well, the first one reports it
+                if (config.unique_cycles && !reported_cycles.insert(result.cycles[i]))
+                    continue;
+                if (config.identify_cycles)
+                    result.races[i].cycle = reported_cycles.id_of(result.cycles[i]);
+                this->lockframe->report_race(result.races[i]);
+            }
+            result = {};
+            in_order = pending.is_finished;
+        }
+        if (!in_order)
+        {
+            unfinished.push_back(std::move(pending));
+        }
+    }
+    pending_starts = std::move(unfinished);
+    for (auto &search : searches)
+    {
+        chains_cut = chains_cut || search.chains_cut;
+    }
 
-        if (!is_traversed->find(*thread_id)->second)
+#ifdef COLLECT_STATISTICS
+    size_t explored_states = 0;
+    for (auto &search : searches)
+    {
+        explored_states += search.states;
+    }
+    this->lockframe->report_statistic("Phase 2 explored states", explored_states);
+    if (config.unique_cycles)
+    {
+        size_t skipped_candidates = 0;
+        for (auto &search : searches)
+        {
+            skipped_candidates += search.skipped_candidates;
+        }
+        this->lockframe->report_statistic("Phase 2 candidates repeating a searched one", skipped_candidates);
+        this->lockframe->report_statistic("Unique cycles", reported_cycles.size());
+    }
+    this->lockframe->report_statistic("Phase 2 pending start dependencies", pending_starts.size());
+#endif
+}
+
+// Returns false if the budget interrupted the search, search->path then holds the candidate positions of the chain to
+// resume from, outermost first.
+bool UNDEADDetector::dfs(CycleSearch *search, int visiting_thread_id, SearchBudget *budget, StartResult *result)
+{
+    std::vector<LockDependency> *chain_stack = &search->chain_stack;
+    std::vector<bool> *is_traversed = &search->is_traversed;
+    // A chain at the length limit can neither close nor grow, its candidates aren't worth a look
+    if (!within_chain_length(chain_stack->size() + 1))
+    {
+        search->chains_cut = true;
+        return true;
+    }
+
+    // A resumed search skips to where it stopped, on the levels above that it re-enters the chain it was extending
+    size_t level = chain_stack->size() - 1;
+    size_t first = 0;
+    bool is_reentering = false;
+    if (level < search->resume.size())
+    {
+        first = search->resume[level];
+        is_reentering = level + 1 < search->resume.size();
+        if (!is_reentering)
+            search->resume.clear();
+    }
+    std::vector<const LockDependency *> *searched = nullptr;
+    if (config.unique_cycles)
+    {
+        searched = &search->searched[level];
+        searched->clear();
+    }
+
+    // A cycle stays within the component of its first lock
+    int component = lock_graph.component(chain_stack->front().lock);
+    // Only dependencies holding the last lock of the chain can extend it (LD-2)
+    auto candidates = dependency_index.holding_after(chain_stack->back().lock, visiting_thread_id);
+    for (auto candidate = candidates.begin() + first; candidate != candidates.end(); ++candidate)
+    {
+        size_t position = candidate - candidates.begin();
+        LockDependency dependency = *candidate;
+
+        if (is_reentering)
+        {
+            // Extended the chain when the search stopped
+            is_reentering = false;
+        }
+        else
         {
-            for (auto &d : thread->dependencies)
+            if (!budget->explore(&search->states))
+            {
+                search->path.insert(search->path.begin(), position);
+                return false;
+            }
+            if ((*is_traversed)[dependency.id] || lock_graph.component(dependency.lock) != component)
+                continue;
+            bool closes = isCycleChain(chain_stack, &dependency);
+            if (searched != nullptr && repeats_searched(*searched, dependency, closes))
             {
-                for (auto &l : d.second)
+                search->skipped_candidates++;
+                continue;
+            }
+            if (!isChain(chain_stack, &dependency))
+                continue;
+            if (closes)
+            {
+                if (searched != nullptr)
+                {
+                    searched->push_back(&*candidate);
+                    CycleSet::Key key = CycleSet::key_of(*chain_stack, dependency);
+                    if (!search->cycles.insert(key))
+                        continue;
+                    result->cycles.push_back(std::move(key));
+                }
+                else if (config.identify_cycles)
                 {
-                    LockDependency dependency = LockDependency{
-                        *thread_id,
-                        l.first,
-                        &d.first};
-
-                    if (isChain(chain_stack, &dependency))
-                    {
-                        if (isCycleChain(chain_stack, &dependency))
-                        {
-                            this->lockframe->report_race(DataRace{dependency.resource_name, 0, chain_stack->front().id, dependency.id});
-                        }
-                        else
-                        {
-                            (*is_traversed)[*thread_id] = true;
-                            chain_stack->push_back(dependency);
-                            dfs(chain_stack, visiting_thread_id, is_traversed, thread_ids);
-                            chain_stack->pop_back();
-                            (*is_traversed)[*thread_id] = false;
-                        }
-                    }
+                    result->cycles.push_back(CycleSet::key_of(*chain_stack, dependency));
                 }
+                result->races.push_back(DataRace{lock_slots.key(dependency.lock), 0, chain_stack->front().id, dependency.id});
+                continue;
             }
         }
+        if (searched != nullptr)
+            searched->push_back(&*candidate);
+
+        (*is_traversed)[dependency.id] = true;
+        chain_stack->push_back(dependency);
+        bool is_done = dfs(search, visiting_thread_id, budget, result);
+        chain_stack->pop_back();
+        (*is_traversed)[dependency.id] = false;
+        if (!is_done)
+        {
+            search->path.insert(search->path.begin(), position);
+            return false;
+        }
     }
+    return true;
 }
 
-bool UNDEADDetector::isChain(std::vector<LockDependency> *chain_stack, LockDependency *dependency)
+// Whether a candidate searched before on the same level has the thread and lock of dependency and, unless they close the
+// cycle, a lockset within the one of dependency. Every chain through dependency then also runs through that candidate,
+// they only repeat its cycles.
+bool UNDEADDetector::repeats_searched(const std::vector<const LockDependency *> &searched, const LockDependency &dependency, bool closes) const
 {
-    for (auto &chain_dep : *chain_stack)
+    for (auto *other : searched)
     {
-        // Check if (LD-3) l_n in ls_1
-        if (chain_dep.resource_name == dependency->resource_name)
-            return false;
-        // Check if (LD-1) LS(ls_i) cap LS(ls_j)
-        for (auto &chain_dep_ls : *chain_dep.lockset)
+        if (other->id == dependency.id && other->lock == dependency.lock && (closes || dependency.lockset->includes(*other->lockset)))
+            return true;
+    }
+    return false;
+}
+
+bool UNDEADDetector::within_chain_length(size_t length) const
+{
+    return config.max_chain_length == 0 || length <= config.max_chain_length;
+}
+
+// Online detection: called for every new dependency before it is added to the index, so every cycle is found exactly
+// once, by the last of its dependencies to appear. The search follows the chains starting at the new dependency with
+// any thread, the cycles it closes are reported rotated to the form find_cycles reports them in. Instead of the lock graph
+// components it only follows locks from which the lockset of the new dependency can be reached again.
+void UNDEADDetector::find_cycles_with(const LockDependency &dependency, TracePosition trace_position)
+{
+    std::fill(reaches_lockset.begin(), reaches_lockset.end(), false);
+    reversed_lock_graph.reachable_from(*dependency.lockset, &reaches_lockset);
+    bool may_close = static_cast<size_t>(dependency.lock) < reaches_lockset.size() && reaches_lockset[dependency.lock];
+    if (may_close)
+    {
+        if (online_search.is_traversed.size() < threads.capacity())
+            online_search.is_traversed.resize(threads.capacity(), false);
+
+        online_search.is_traversed[dependency.id] = true;
+        online_search.chain_stack.push_back(dependency);
+        online_dfs(trace_position);
+        online_search.chain_stack.pop_back();
+        online_search.is_traversed[dependency.id] = false;
+    }
+
+    for (LockIndex held : *dependency.lockset)
+        reversed_lock_graph.add_edge(dependency.lock, held);
+}
+
+void UNDEADDetector::online_dfs(TracePosition trace_position)
+{
+    std::vector<LockDependency> *chain_stack = &online_search.chain_stack;
+    for (auto &candidate : dependency_index.holding(chain_stack->back().lock))
+    {
+        if (online_search.is_traversed[candidate.id] || !reaches_lockset[candidate.lock])
+            continue;
+
+        LockDependency dependency = candidate;
+
+        if (isChain(chain_stack, &dependency))
         {
-            for (auto &dependency_ls : *dependency->lockset)
+            if (!within_chain_length(chain_stack->size() + 1))
             {
-                if (chain_dep_ls == dependency_ls)
-                    return false;
+                chains_cut = true;
+                continue;
             }
+            // A chain closing at the new dependency may still be a prefix of a cycle of another rotation, keep going
+            bool closes = isCycleChain(chain_stack, &dependency);
+            online_search.is_traversed[dependency.id] = true;
+            chain_stack->push_back(dependency);
+            if (closes)
+                report_online_cycle(trace_position);
+            online_dfs(trace_position);
+            chain_stack->pop_back();
+            online_search.is_traversed[dependency.id] = false;
         }
     }
-    // Check if (LD-2) l_i in ls_i+1 for i=1,...,n-1
-    for (auto &dependency_ls : *dependency->lockset)
+}
+
+void UNDEADDetector::report_online_cycle(TracePosition trace_position)
+{
+    const std::vector<LockDependency> &cycle = online_search.chain_stack;
+    size_t length = cycle.size();
+    // find_cycles starts its chains at the lowest thread and stops them at the first dependency closing the cycle
+    size_t first = 0;
+    for (size_t i = 1; i < length; i++)
     {
-        if (chain_stack->back().resource_name == dependency_ls)
-            return true;
+        if (cycle[i].id < cycle[first].id)
+            first = i;
     }
-    return false;
+    for (size_t i = 1; i + 1 < length; i++)
+    {
+        if (cycle[first].lockset->contains(cycle[(first + i) % length].lock))
+            return;
+    }
+    CycleSet::Key key = config.unique_cycles || config.identify_cycles ? CycleSet::key_of(cycle) : CycleSet::Key{};
+    if (config.unique_cycles && !reported_cycles.insert(key))
+        return;
+    const LockDependency &last = cycle[(first + length - 1) % length];
+    DataRace race{lock_slots.key(last.lock), trace_position, cycle[first].id, last.id};
+    if (config.identify_cycles)
+        race.cycle = reported_cycles.id_of(key);
+    this->lockframe->report_race(race);
 }
 
-bool UNDEADDetector::isCycleChain(std::vector<LockDependency> *chain_stack, LockDependency *dependency)
+bool UNDEADDetector::isChain(std::vector<LockDependency> *chain_stack, LockDependency *dependency)
 {
-    for (auto &chain_dep_ls : *chain_stack->front().lockset)
+    for (auto &chain_dep : *chain_stack)
     {
-        if (chain_dep_ls == dependency->resource_name)
-            return true;
+        // Check if (LD-3) l_n in ls_1
+        if (chain_dep.lock == dependency->lock)
+            return false;
+        // Check if (LD-1) LS(ls_i) cap LS(ls_j)
+        if (chain_dep.lockset->overlaps(*dependency->lockset))
+            return false;
     }
-    return false;
+    // Check if (LD-2) l_i in ls_i+1 for i=1,...,n-1
+    return dependency->lockset->contains(chain_stack->back().lock);
+}
+
+bool UNDEADDetector::isCycleChain(std::vector<LockDependency> *chain_stack, LockDependency *dependency)
+{
+    return chain_stack->front().lockset->contains(dependency->lock);
 }
 
 UNDEADDetector::Thread *UNDEADDetector::get_thread(ThreadID thread_id)
 {
-    auto current_thread_ptr = threads.find(thread_id);
-    if (current_thread_ptr == threads.end())
+    Thread *current_thread = threads.find(thread_id);
+    if (current_thread == nullptr)
     {
-        return &threads.insert({thread_id,
-                                Thread{
-                                    thread_id,
-                                    {}}})
-                    .first->second;
+        return threads.insert(thread_id,
+                              Thread{
+                                  thread_id,
+                                  {}});
     }
     else
     {
-        return &current_thread_ptr->second;
+        return current_thread;
     }
 }
 
@@ -135,23 +371,27 @@ void UNDEADDetector::acquire_event(ThreadID thread_id, TracePosition trace_posit
 {
     Thread *thread = get_thread(thread_id);
 
-    auto ls_map = thread->dependencies.find(thread->lockset);
-    if (ls_map == thread->dependencies.end())
+    LockIndex lock = lock_slots.slot(resource_name);
+    bool is_new = thread->dependencies[thread->lockset].insert({lock, true}).second;
+    if (is_new)
+        search_prepared = false;
+    // Dependencies without held locks extend no chain
+    if (is_new && config.online_deadlock_detection && thread->lockset != LockSetTable::EMPTY)
     {
-        ls_map = thread->dependencies.insert({thread->lockset, {}}).first;
+        LockDependency dependency{thread_id, lock, &locksets.get(thread->lockset)};
+        find_cycles_with(dependency, trace_position);
+        dependency_index.add(*dependency.lockset, dependency);
     }
 
-    ls_map->second.insert({resource_name, true});
-
     // push l to LockSet[t]
-    thread->lockset.insert(resource_name);
+    thread->lockset = locksets.with(thread->lockset, lock);
 }
 
 void UNDEADDetector::release_event(ThreadID thread_id, TracePosition trace_position, ResourceName resource_name)
 {
     Thread *thread = get_thread(thread_id);
 
-    thread->lockset.erase(resource_name);
+    thread->lockset = locksets.without(thread->lockset, lock_slots.slot(resource_name));
 }
 
 void UNDEADDetector::read_event(ThreadID thread_id, TracePosition trace_position, ResourceName resource_name)
@@ -173,17 +413,28 @@ void UNDEADDetector::join_event(ThreadID thread_id, TracePosition trace_position
 void UNDEADDetector::notify_event(ThreadID thread_id, TracePosition trace_position, ResourceName resource_name) {}
 void UNDEADDetector::wait_event(ThreadID thread_id, TracePosition trace_position, ResourceName resource_name) {}
 
+void UNDEADDetector::process_batch(const Event *events, size_t count) {
+    dispatch_events(this, events, count);
+}
+
 void UNDEADDetector::get_races()
 {
 #ifdef COLLECT_STATISTICS
     auto start = std::chrono::steady_clock::now();
 #endif
 
-    find_cycles();
+    // The online detection already reported every cycle
+    if (!config.online_deadlock_detection)
+        find_cycles();
 
 #ifdef COLLECT_STATISTICS
     auto end = std::chrono::steady_clock::now();
 
     this->lockframe->report_statistic("Phase 2 elapsed time in milliseconds", std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count());
 #endif
+}
+
+bool UNDEADDetector::is_complete() const
+{
+    return pending_starts.empty() && !chains_cut;
 }
\ No newline at end of file
@@ -2,37 +2,96 @@
 #define UNDEAD_H
 
 #include <vector>
-#include <set>
 #include <map>
 #include <unordered_map>
 #include <algorithm>
 #include "detector.hpp"
 #include "vectorclock.hpp"
+#include "slots.hpp"
+#include "lockset.hpp"
+#include "lockgraph.hpp"
+#include "dependencyindex.hpp"
+#include "searchbudget.hpp"
+#include "cycleset.hpp"
 
 class LockFrame;
-class UNDEADDetector : public Detector {
+class UNDEADDetector final : public Detector {
     private:
         struct Thread {
             ThreadID id;
-            std::set<ResourceName> lockset = {};
+            LockSetID lockset = LockSetTable::EMPTY;
             // Use map to find LockDependency faster.
-            // We basically keep track of all unique locksets in D and then have a set that contains all resources that
+            // We basically keep track of all unique locksets in D and then have a set that contains all locks that
             // were acquired when this lockset was in place.
-            std::map<std::set<ResourceName>, std::unordered_map<ResourceName, bool>> dependencies;
+            std::map<LockSetID, std::unordered_map<LockIndex, bool>> dependencies;
         };
 
         struct LockDependency {
             ThreadID id;
-            ResourceName resource_name;
-            const std::set<ResourceName>* lockset;
+            LockIndex lock;
+            const LockSet* lockset;
         };
 
-        std::unordered_map<ThreadID, Thread> threads = {};
+        // Search state of one worker thread in find_cycles
+        struct CycleSearch {
+            std::vector<LockDependency> chain_stack = {};
+            std::vector<bool> is_traversed = {};
+            // Candidate positions per chain level to resume from, and where the search stopped
+            std::vector<size_t> resume = {};
+            std::vector<size_t> path = {};
+            size_t states = 0;
+            bool chains_cut = false;
+            // With unique_cycles: the cycles of the current start, and per chain level the candidates already searched
+            CycleSet cycles = {};
+            std::vector<std::vector<const LockDependency*>> searched = {};
+            size_t skipped_candidates = 0;
+        };
+
+        // What the search from one start found, with unique_cycles or identify_cycles the cycle of every race
+        struct StartResult {
+            std::vector<DataRace> races;
+            std::vector<CycleSet::Key> cycles;
+        };
+
+        // A start of find_cycles whose races weren't all reported yet, with the position the search stopped at and,
+        // once an earlier start was interrupted, what it found so far
+        struct PendingStart {
+            size_t start;
+            std::vector<size_t> path;
+            bool is_finished;
+            StartResult found;
+        };
+
+        SlotTable<Thread> threads = {};
+        SlotMap lock_slots;
+        LockSetTable locksets = {};
+        LockGraph lock_graph = {};
+        DependencyIndex<LockDependency> dependency_index = {};
+        // Checkpoint of find_cycles: the starts not reported to the end yet, valid until a new dependency appears
+        std::vector<LockDependency> starts = {};
+        std::vector<PendingStart> pending_starts = {};
+        bool search_prepared = false;
+        // Whether the chain length limit kept a chain from being searched
+        bool chains_cut = false;
+        // With unique_cycles or identify_cycles: every cycle reported so far
+        CycleSet reported_cycles = {};
+        // Search state of the online detection, which is all on the thread feeding the events
+        CycleSearch online_search = {};
+        // Edges lock -> held of the lock graph, to find the locks from which the lockset of a new dependency is reachable
+        LockGraph reversed_lock_graph = {};
+        // The locks of the current online search that reach its lockset, every lock of a cycle through it does
+        std::vector<bool> reaches_lockset = {};
 
-        void dfs(std::vector<LockDependency>* chain_stack, int visiting_thread_id, std::unordered_map<ThreadID, bool>* is_traversed, std::set<ThreadID>* thread_ids);
+        bool dfs(CycleSearch* search, int visiting_thread_id, SearchBudget* budget, StartResult* result);
+        bool repeats_searched(const std::vector<const LockDependency*> &searched, const LockDependency &dependency, bool closes) const;
+        bool within_chain_length(size_t length) const;
         bool isChain(std::vector<LockDependency>* chain_stack, LockDependency* dependency);
         bool isCycleChain(std::vector<LockDependency>* chain_stack, LockDependency* dependency);
+        void prepare_search();
         void find_cycles();
+        void find_cycles_with(const LockDependency &dependency, TracePosition trace_position);
+        void online_dfs(TracePosition trace_position);
+        void report_online_cycle(TracePosition trace_position);
     public:
         Thread* get_thread(ThreadID thread_id);
         void read_event(ThreadID, TracePosition, ResourceName);
@@ -43,7 +102,9 @@ class UNDEADDetector : public Detector {
         void join_event(ThreadID, TracePosition, ThreadID);
         void notify_event(ThreadID, TracePosition, ResourceName);
         void wait_event(ThreadID, TracePosition, ResourceName);
+        void process_batch(const Event*, size_t) override;
         void get_races();
+        bool is_complete() const override;
 };
 
 #endif
\ No newline at end of file
@@ -1,99 +1,142 @@
 #include "vectorclock.hpp"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
+static_assert(sizeof(VectorClockValue) == 4, "SIMD paths expect 32 bit clock values");
+
 VectorClock::VectorClock() {}
 VectorClock::VectorClock(ThreadID increment_thread_id) {
     this->set(increment_thread_id, 1);
 }
 
-VectorClockValue VectorClock::find(ThreadID thread_id) {
-    auto vc = this->_vector_clock.find(thread_id);
-
-    if(vc == this->_vector_clock.end()) {
-        return 0;
-    } else {
-        return vc->second;
-    }
-}
-
-std::vector<Epoch> VectorClock::find_all() {
+std::vector<Epoch> VectorClock::find_all() const {
     std::vector<Epoch> pairs;
 
-    for(const auto &[thread_id, value] : this->_vector_clock) {
-        pairs.push_back(Epoch { thread_id, value });
+    for(size_t thread_id = 0; thread_id < this->_vector_clock.size(); ++thread_id) {
+        if(this->_vector_clock[thread_id] != 0) {
+            pairs.push_back(Epoch { static_cast<ThreadID>(thread_id), this->_vector_clock[thread_id] });
+        }
     }
 
     return pairs;
 }
 
-void VectorClock::set(ThreadID thread_id, VectorClockValue value) {
-    this->_vector_clock[thread_id] = value;
+VectorClock VectorClock::merge(const VectorClock &vector_clock) const {
+    VectorClock new_vector_clock = *this;
+    new_vector_clock.merge_into(&vector_clock);
+    return new_vector_clock;
 }
 
 /**
- * Loop through all the keys of each vc, compare epoch with the other, take maximum.
+ * Pointwise maximum, missing entries of this clock are filled up with zeros first.
  */
-VectorClock VectorClock::merge(VectorClock vector_clock) {
-    VectorClock new_vector_clock;
-
-    for(const auto &[thread_id, value] : this->_vector_clock) {
-        new_vector_clock.set(thread_id, value);
+void VectorClock::merge_into(const VectorClock* vector_clock) {
+    const size_t size = vector_clock->_vector_clock.size();
+    if(_vector_clock.size() < size) {
+        _vector_clock.resize(size, 0);
     }
 
-    for(const Epoch epoch : vector_clock.find_all()) {
-        VectorClockValue current_value = new_vector_clock.find(epoch.thread_id);
-        if(current_value < epoch.value) {
-            new_vector_clock.set(epoch.thread_id, epoch.value);
+    VectorClockValue* dst = _vector_clock.data();
+    const VectorClockValue* src = vector_clock->_vector_clock.data();
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    for(; i + 8 <= size; i += 8) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_max_epi32(a, b));
+    }
+#endif
+#if defined(__AVX2__) || defined(__SSE4_1__)
+    for(; i + 4 <= size; i += 4) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_max_epi32(a, b));
+    }
+#endif
+    for(; i < size; ++i) {
+        if(dst[i] < src[i]) {
+            dst[i] = src[i];
         }
     }
-
-    return new_vector_clock;
 }
 
-void VectorClock::merge_into(VectorClock* vector_clock) {
-    for(const auto &[thread_id, value]: vector_clock->_vector_clock) {
-        auto vc = _vector_clock.find(thread_id);
-        if(vc == _vector_clock.end()) {
-            _vector_clock[thread_id] = value;
-        } else if(vc->second < value) {
-            vc->second = value;
+/**
+ * Compares both clocks entry by entry. Sets *one_strictly_smaller if some entry of this clock is set (> 0)
+ * and smaller than the other one. Entries that are 0 in this clock never count as strictly smaller, this is
+ * the behaviour of the former sparse representation which only visited the entries stored in this clock.
+ */
+static bool compare_less_than_or_equal(const std::vector<VectorClockValue> &lhs, const std::vector<VectorClockValue> &rhs, bool *one_strictly_smaller) {
+    const size_t common_size = lhs.size() < rhs.size() ? lhs.size() : rhs.size();
+    const VectorClockValue* a_values = lhs.data();
+    const VectorClockValue* b_values = rhs.data();
+    bool strictly_smaller = false;
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256i zero_256 = _mm256_setzero_si256();
+    __m256i strictly_smaller_256 = _mm256_setzero_si256();
+    for(; i + 8 <= common_size; i += 8) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a_values + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b_values + i));
+        __m256i greater = _mm256_cmpgt_epi32(a, b);
+        if(!_mm256_testz_si256(greater, greater)) {
+            return false;
         }
+        strictly_smaller_256 = _mm256_or_si256(strictly_smaller_256, _mm256_and_si256(_mm256_cmpgt_epi32(b, a), _mm256_cmpgt_epi32(a, zero_256)));
     }
-}
-
-void VectorClock::increment(ThreadID thread_id) {
-    VectorClockValue old_value = this->find(thread_id);
-    if(old_value == 0) {
-        this->set(thread_id, 1);
-    } else {
-        this->set(thread_id, old_value + 1);
+    strictly_smaller = !_mm256_testz_si256(strictly_smaller_256, strictly_smaller_256);
+#endif
+#if defined(__AVX2__) || defined(__SSE4_1__)
+    const __m128i zero_128 = _mm_setzero_si128();
+    __m128i strictly_smaller_128 = _mm_setzero_si128();
+    for(; i + 4 <= common_size; i += 4) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a_values + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b_values + i));
+        __m128i greater = _mm_cmpgt_epi32(a, b);
+        if(!_mm_testz_si128(greater, greater)) {
+            return false;
+        }
+        strictly_smaller_128 = _mm_or_si128(strictly_smaller_128, _mm_and_si128(_mm_cmpgt_epi32(b, a), _mm_cmpgt_epi32(a, zero_128)));
     }
-}
-
-bool VectorClock::less_than(VectorClock* other_vector_clock) {
-    bool one_strictly_smaller = false;
-
-    for(const auto &[thread_id, value]: this->_vector_clock) {
-        auto other_vc_val = other_vector_clock->find(thread_id);
-
-        if(value > other_vc_val) {
+    strictly_smaller = strictly_smaller || !_mm_testz_si128(strictly_smaller_128, strictly_smaller_128);
+#endif
+    for(; i < common_size; ++i) {
+        if(a_values[i] > b_values[i]) {
             return false;
         }
-        if(value < other_vc_val) {
-            one_strictly_smaller = true;
+        if(a_values[i] > 0 && a_values[i] < b_values[i]) {
+            strictly_smaller = true;
         }
     }
 
-    return one_strictly_smaller;
-}
-
-bool VectorClock::less_than_or_equal(VectorClock* other_vector_clock) {
-    for(const auto &[thread_id, value]: this->_vector_clock) {
-        auto other_vc_val = other_vector_clock->find(thread_id);
-
-        if(value > other_vc_val) {
+    // Entries only this clock has are compared against an implicit 0 in the other one.
+    for(; i < lhs.size(); ++i) {
+        if(a_values[i] > 0) {
             return false;
         }
     }
 
+    if(one_strictly_smaller != nullptr) {
+        *one_strictly_smaller = strictly_smaller;
+    }
     return true;
-}
\ No newline at end of file
+}
+
+bool VectorClock::less_than(const VectorClock* other_vector_clock) const {
+    bool one_strictly_smaller = false;
+
+    if(!compare_less_than_or_equal(this->_vector_clock, other_vector_clock->_vector_clock, &one_strictly_smaller)) {
+        return false;
+    }
+
+    return one_strictly_smaller;
+}
+
+bool VectorClock::less_than_or_equal(const VectorClock* other_vector_clock) const {
+    return compare_less_than_or_equal(this->_vector_clock, other_vector_clock->_vector_clock, nullptr);
+}
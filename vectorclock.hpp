@@ -1,25 +1,41 @@
 #ifndef VECTORCLOCK_H
 #define VECTORCLOCK_H
 
-#include <unordered_map>
 #include <vector>
 #include "lockframe.hpp"
 #include <iterator>
 #include "vectorclock_types.hpp"
 
+/**
+ * Dense vector clock. Entry i holds the clock value of thread slot i, entries past the end are 0.
+ * Keeping the values contiguous lets merge_into and the comparisons run as AVX2/SSE4.1 loops
+ * instead of hash map lookups.
+ */
 class VectorClock {
     public:
-        std::unordered_map<ThreadID, VectorClockValue> _vector_clock = {};
+        std::vector<VectorClockValue> _vector_clock = {};
         VectorClock();
         VectorClock(ThreadID increment_thread_id);
-        VectorClockValue find(ThreadID thread_id);
-        std::vector<Epoch> find_all();
-        VectorClock merge(VectorClock vector_clock);
-        void merge_into(VectorClock* vector_clock);
-        void set(ThreadID thread_id, VectorClockValue);
-        void increment(ThreadID thread_id);
-        bool less_than(VectorClock* vector_clock);
-        bool less_than_or_equal(VectorClock* vector_clock);
+        inline VectorClockValue find(ThreadID thread_id) const {
+            return static_cast<size_t>(thread_id) < _vector_clock.size() ? _vector_clock[thread_id] : 0;
+        }
+        std::vector<Epoch> find_all() const;
+        VectorClock merge(const VectorClock &vector_clock) const;
+        void merge_into(const VectorClock* vector_clock);
+        inline void set(ThreadID thread_id, VectorClockValue value) {
+            if(static_cast<size_t>(thread_id) >= _vector_clock.size()) {
+                _vector_clock.resize(thread_id + 1, 0);
+            }
+            _vector_clock[thread_id] = value;
+        }
+        inline void increment(ThreadID thread_id) {
+            if(static_cast<size_t>(thread_id) >= _vector_clock.size()) {
+                _vector_clock.resize(thread_id + 1, 0);
+            }
+            _vector_clock[thread_id] += 1;
+        }
+        bool less_than(const VectorClock* vector_clock) const;
+        bool less_than_or_equal(const VectorClock* vector_clock) const;
 };
 
-#endif
\ No newline at end of file
+#endif